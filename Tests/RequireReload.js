@@ -0,0 +1,4 @@
+// Module loaded by \JS\Tests\RequireReload.sqf (from the @JS mod folder on disk)
+var dependency = require("./RequireReloadDependency");
+
+exports.value = dependency.value + 1;
\ No newline at end of file
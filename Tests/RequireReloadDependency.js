@@ -0,0 +1,2 @@
+// Relative require() from within a module
+exports.value = 1;
\ No newline at end of file
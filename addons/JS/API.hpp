@@ -16,6 +16,44 @@
 #define JS_PROTOCOL_TOKEN_TERMINATE 'T'
 #define JS_PROTOCOL_TOKEN_DONE 'D'
 #define JS_PROTOCOL_TOKEN_VERSION 'V'
+#define JS_PROTOCOL_TOKEN_METRICS 'M'
+#define JS_PROTOCOL_TOKEN_NAMESPACE 'N'
+#define JS_PROTOCOL_TOKEN_SANDBOX 'X'
+#define JS_PROTOCOL_TOKEN_BUDGET 'B'
+#define JS_PROTOCOL_TOKEN_STATS 'A'
+#define JS_PROTOCOL_TOKEN_TERMINATE_WAIT 'W'
+#define JS_PROTOCOL_TOKEN_SPAWN_PRIORITY 'P'
+#define JS_PROTOCOL_TOKEN_SPAWN_GROUP 'G'
+#define JS_PROTOCOL_TOKEN_WAIT_ALL 'J'
+#define JS_PROTOCOL_TOKEN_WAIT_ANY 'Y'
+#define JS_PROTOCOL_TOKEN_IDLE 'L'
+#define JS_PROTOCOL_TOKEN_LOW_MEMORY 'R'
+
+// Namespaced commands (separate JavaScript isolate for each addon) use
+// "#N<namespace>:<payload>" format, where payload is JavaScript code or
+// any other protocol command.
+#define JS_PROTOCOL_NAMESPACE_SEPARATOR ':'
+
+// Time budget commands (JS_fnc_exec or JS_fnc_sandbox with a timeout) use
+// "#B<milliseconds>:<payload>" format. A namespaced command payload can
+// also be a time budget command. Blocking terminate commands use the same
+// "#W<milliseconds>:<script handle>" format.
+#define JS_PROTOCOL_BUDGET_SEPARATOR ':'
+
+// Prioritized spawn commands use "#P<priority><code>" format, where priority
+// is a single digit priority class.
+#define JS_PRIORITY_HIGH 0
+#define JS_PRIORITY_NORMAL 1
+#define JS_PRIORITY_LOW 2
+#define JS_PRIORITY_CLASSES 3
+
+// Spawn group commands use "#G<code 1><RS><code 2><RS>..." format or
+// "#G<function><US><JSON array of argument arrays>" format (one function
+// compiled once and called with each argument set). Group handles can be
+// used with done/terminate commands and "#J<milliseconds>:<handle>" (wait
+// all) or "#Y<milliseconds>:<handle>" (wait any) commands.
+#define JS_PROTOCOL_GROUP_SEPARATOR 30
+#define JS_PROTOCOL_GROUP_ARGUMENTS_SEPARATOR 31
 
 // Full command strings (for SQF)
 #define JS_PROTOCOL_COMMAND_INIT "#I"
@@ -23,6 +61,20 @@
 #define JS_PROTOCOL_COMMAND_TERMINATE "#T"
 #define JS_PROTOCOL_COMMAND_DONE "#D"
 #define JS_PROTOCOL_COMMAND_VERSION "#V"
+#define JS_PROTOCOL_COMMAND_METRICS "#M"
+#define JS_PROTOCOL_COMMAND_NAMESPACE "#N"
+#define JS_PROTOCOL_COMMAND_SANDBOX "#X"
+#define JS_PROTOCOL_COMMAND_BUDGET "#B"
+#define JS_PROTOCOL_COMMAND_STATS "#A"
+#define JS_PROTOCOL_COMMAND_TERMINATE_WAIT "#W"
+#define JS_PROTOCOL_COMMAND_SPAWN_PRIORITY "#P"
+#define JS_PROTOCOL_COMMAND_SPAWN_GROUP "#G"
+#define JS_PROTOCOL_COMMAND_WAIT_ALL "#J"
+#define JS_PROTOCOL_COMMAND_WAIT_ANY "#Y"
+#define JS_PROTOCOL_COMMAND_IDLE "#L"
+#define JS_PROTOCOL_COMMAND_LOW_MEMORY "#R"
+#define JS_PROTOCOL_STRING_NAMESPACE_SEPARATOR ":"
+#define JS_PROTOCOL_STRING_BUDGET_SEPARATOR ":"
 
 // Macro-based JavaScript code execution
 #define JS(CODE) (call compile ("JavaScript" callExtension ##CODE##))
\ No newline at end of file
@@ -25,18 +25,37 @@ class CfgFunctions
 				file = "\JS\fn_init.sqf";
 				forcedStart = 1;
 			};
+			class json
+			{
+				scope = 0;
+				description = "Private function used to serialize SQF values as JSON.";
+				file = "\JS\fn_json.sqf";
+				headerType = -1;
+			};
 			class exec
 			{
 				description = "Execute JavaScript code and return the value.";
 				file = "\JS\fn_exec.sqf";
 				headerType = -1;
 			};
+			class sandbox
+			{
+				description = "Execute JavaScript code in an isolated sandbox context and return the value.";
+				file = "\JS\fn_sandbox.sqf";
+				headerType = -1;
+			};
 			class spawn
 			{
 				description = "Execute JavaScript code in parallel (non-blocking mode).";
 				file = "\JS\fn_spawn.sqf";
 				headerType = -1;
 			};
+			class spawnGroup
+			{
+				description = "Execute multiple JavaScript scripts in parallel (non-blocking mode) as a group.";
+				file = "\JS\fn_spawnGroup.sqf";
+				headerType = -1;
+			};
 			class terminate
 			{
 				description = "Terminate (abort) a spawned JavaScript script.";
@@ -49,12 +68,42 @@ class CfgFunctions
 				file = "\JS\fn_done.sqf";
 				headerType = -1;
 			};
+			class wait
+			{
+				description = "Wait until a spawned JavaScript script (or all/any script of a group) is done.";
+				file = "\JS\fn_wait.sqf";
+				headerType = -1;
+			};
+			class idle
+			{
+				description = "Use idle time (e.g. frame end or game pause) for JavaScript garbage collection.";
+				file = "\JS\fn_idle.sqf";
+				headerType = -1;
+			};
+			class lowMemory
+			{
+				description = "Release JavaScript memory (shed native caches and compact the heap).";
+				file = "\JS\fn_lowMemory.sqf";
+				headerType = -1;
+			};
+			class stats
+			{
+				description = "Get wall and CPU time of a spawned JavaScript script.";
+				file = "\JS\fn_stats.sqf";
+				headerType = -1;
+			};
 			class version
 			{
 				description = "Get addon and JavaScript engine version information.";
 				file = "\JS\fn_version.sqf";
 				headerType = -1;
 			};
+			class metrics
+			{
+				description = "Get runtime metrics of the JavaScript extension.";
+				file = "\JS\fn_metrics.sqf";
+				headerType = -1;
+			};
 		};
 	};
 };
\ No newline at end of file
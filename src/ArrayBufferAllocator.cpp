@@ -0,0 +1,34 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ArrayBufferAllocator.h"
+
+#include <cstdlib>
+
+// Allocate zero initialized memory
+void* ArrayBufferAllocator::Allocate(size_t length) {
+
+	// NOTE: New ArrayBuffer contents must be zeroed (zero length buffers still need a valid pointer)
+	return calloc(max(length, static_cast<size_t>(1)), 1);
+}
+
+// Free memory of an ArrayBuffer
+void ArrayBufferAllocator::Free(void* data) {
+	free(data);
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+
+// Memory of ArrayBuffer (and typed array) contents, shared by all isolates
+// NOTE: Must be installed with v8::V8::SetArrayBufferAllocator() before the first isolate is used
+class ArrayBufferAllocator: public v8::ArrayBuffer::Allocator {
+
+public:
+
+	// Allocate zero initialized memory (NULL if allocation failed)
+	virtual void* Allocate(size_t length);
+
+	// Free memory of an ArrayBuffer
+	virtual void Free(void* data);
+};
\ No newline at end of file
@@ -0,0 +1,98 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+
+#include <vector>
+
+class Runtime;
+
+// Background (spawned) script state
+// NOTE: All per-script state lives here (worker threads are reused between scripts)
+struct BackgroundScript {
+
+	BackgroundScript(): id(0), groupID(0), runtime(NULL), terminationEvent(NULL), isTerminating(false), isRunning(false), threadID(0), priority(JS_PRIORITY_NORMAL), queueTime(0), thread(NULL), startTime(0), startThreadTime(0) {}
+
+	// Termination event is closed with the last reference (JS_fnc_terminate may still signal it after the script is done)
+	~BackgroundScript() {
+
+		if (terminationEvent != NULL) {
+			CloseHandle(terminationEvent);
+		}
+	}
+
+	// Script ID (slot table index and generation, see ScriptTable)
+	uint32 id;
+
+	// Spawn group ID (0 if not part of a group)
+	uint32 groupID;
+
+	// Runtime and source key of a coalescable queued script (empty if not coalescable)
+	std::string coalesceKey;
+
+	// Runtime (isolate and context) the script is running in
+	Runtime* runtime;
+
+	// Compiled script, or a function shared by a spawn group and its arguments (released by the worker thread)
+	v8::Persistent<v8::Script> script;
+	v8::Persistent<v8::Function> function;
+	v8::Persistent<v8::Value> arguments;
+
+	// Termination event (signaled by JS_fnc_terminate, closed by the destructor)
+	HANDLE terminationEvent;
+
+	// Script execution is being terminated
+	// NOTE: Guarded by the state mutex (set by JS_fnc_terminate and by waits that see the termination event)
+	bool isTerminating;
+
+	// Script thread holds the isolate lock (termination can be delivered right away)
+	// NOTE: Only changed by the script thread while holding the isolate lock, guarded by the state mutex
+	bool isRunning;
+	std::mutex stateMutex;
+
+	// V8 thread ID of the worker thread (used to terminate a preempted script)
+	int threadID;
+
+	// Priority class (JS_PRIORITY_HIGH, JS_PRIORITY_NORMAL or JS_PRIORITY_LOW)
+	int priority;
+
+	// Time when the script was queued (in microseconds)
+	double queueTime;
+
+	// Worker thread running the script (NULL while queued) and its start times
+	// NOTE: Used for fairness accounting (JS_fnc_stats), guarded by the background scripts mutex
+	HANDLE thread;
+	double startTime;
+	double startThreadTime;
+};
+
+// Group of background scripts spawned together (JS_fnc_spawnGroup)
+struct BackgroundScriptGroup {
+
+	BackgroundScriptGroup(): total(0), live(0) {}
+
+	// Script IDs of all group members
+	std::vector<uint32> scripts;
+
+	// Number of all and not yet finished group members
+	uint32 total;
+	uint32 live;
+};
\ No newline at end of file
@@ -0,0 +1,56 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CancellationToken.h"
+#include "Extension.h"
+#include "BackgroundScript.h"
+#include "Watchdog.h"
+
+// Constructor
+CancellationToken::CancellationToken(HANDLE event): event(event) {
+
+}
+
+// Token of the background script or time budgeted exec running on the current thread
+CancellationToken CancellationToken::Current() {
+
+	BackgroundScript* backgroundScript = Extension::GetCurrentScript();
+
+	// JS_fnc_exec with a time budget is cancelled when the budget runs out
+	if (backgroundScript == NULL) {
+		return CancellationToken(Watchdog::CurrentEvent());
+	}
+
+	return CancellationToken(backgroundScript->terminationEvent);
+}
+
+// Script is being terminated
+bool CancellationToken::IsCancelled() const {
+	return event != NULL && WaitForSingleObject(event, 0) == WAIT_OBJECT_0;
+}
+
+// Token belongs to a background script or time budgeted exec (can be cancelled at all)
+bool CancellationToken::IsValid() const {
+	return event != NULL;
+}
+
+// Manual-reset event signaled on cancellation (NULL if not valid)
+HANDLE CancellationToken::GetEvent() const {
+	return event;
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+
+// Cancellation token of a background script (signaled when the script is terminated) or a time budgeted exec (signaled when the budget runs out)
+// NOTE: Blocking native calls observe the token to abort early, it is only valid while the script is running
+class CancellationToken {
+
+public:
+
+	CancellationToken(HANDLE event = NULL);
+
+	// Token of the background script or time budgeted exec running on the current thread (never cancelled otherwise)
+	static CancellationToken Current();
+
+	// Script is being terminated
+	bool IsCancelled() const;
+
+	// Token belongs to a background script or time budgeted exec (can be cancelled at all)
+	bool IsValid() const;
+
+	// Manual-reset event signaled on cancellation (NULL if not valid)
+	HANDLE GetEvent() const;
+
+private:
+
+	HANDLE event;
+};
\ No newline at end of file
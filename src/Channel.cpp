@@ -0,0 +1,316 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Channel.h"
+#include "Extension.h"
+#include "JavaScript.h"
+#include "Natives.h"
+#include "Metrics.h"
+
+// Default channel capacity
+#define CHANNEL_CAPACITY 64
+
+// Maximum channel capacity (every cell is allocated up front)
+#define CHANNEL_MAX_CAPACITY 65536
+
+// Open channels (name => channel)
+std::unordered_map<std::string, shared_ptr<Channel>> Channel::channels;
+std::mutex Channel::channelsMutex;
+
+// Constructor
+Channel::Channel(const std::string &name, size_t capacity): name(name), buffer(capacity) {
+
+	LONG size = static_cast<LONG>(buffer.Capacity());
+
+	filledCells = CreateSemaphoreA(NULL, 0, size, NULL);
+	freeCells = CreateSemaphoreA(NULL, size, size, NULL);
+}
+
+// Register channel as a lazily installed native module
+void Channel::Register() {
+	Natives::Get().Register("channel", Channel::Create);
+}
+
+// Create channel module object (on first access)
+v8::Handle<v8::Value> Channel::Create() {
+
+	v8::HandleScope handleScope(v8::Isolate::GetCurrent());
+	v8::PropertyAttribute attributes = static_cast<v8::PropertyAttribute>(v8::DontDelete | v8::ReadOnly);
+
+	v8::Handle<v8::ObjectTemplate> channel = v8::ObjectTemplate::New();
+	channel->Set(v8::String::NewSymbol("open"), v8::FunctionTemplate::New(Channel::Open), attributes);
+	channel->Set(v8::String::NewSymbol("close"), v8::FunctionTemplate::New(Channel::Close), attributes);
+
+	return handleScope.Close(channel->NewInstance());
+}
+
+// channel.open(name, capacity)
+void Channel::Open(const v8::FunctionCallbackInfo<v8::Value>& args) {
+
+	v8::Isolate* isolate = args.GetIsolate();
+	v8::HandleScope handleScope(isolate);
+
+	if (!args.Length() || !args[0]->IsString()) {
+		v8::ThrowException(v8::Exception::TypeError(v8::String::New("Usage: channel.open(name, capacity)")));
+		return;
+	}
+
+	std::string name(*v8::String::Utf8Value(args[0]));
+	size_t capacity = CHANNEL_CAPACITY;
+	bool isCapacity = false;
+
+	if (args.Length() > 1 && args[1]->IsNumber()) {
+
+		double value = args[1]->NumberValue();
+
+		// Checked before rounding up (huge capacities would overflow)
+		if (value > CHANNEL_MAX_CAPACITY) {
+			v8::ThrowException(v8::Exception::RangeError(v8::String::New("channel.open() supports up to 65536 values")));
+			return;
+		}
+
+		if (value >= 1) {
+			capacity = static_cast<size_t>(value);
+			isCapacity = true;
+		}
+	}
+
+	shared_ptr<Channel> channel;
+
+	{
+		std::lock_guard<std::mutex> lock(channelsMutex);
+
+		auto it = channels.find(name);
+
+		if (it != channels.end()) {
+			channel = it->second;
+		}
+		else {
+			channel = make_shared<Channel>(name, capacity);
+			channels[name] = channel;
+		}
+	}
+
+	// Existing channel cannot be resized (explicit capacity must match)
+	if (isCapacity && channel->buffer.Capacity() != RingBuffer<std::string>::Round(capacity)) {
+
+		std::stringstream message;
+		message << "Channel \"" << name << "\" is already open with capacity " << channel->buffer.Capacity();
+
+		v8::ThrowException(v8::Exception::RangeError(v8::String::New(message.str().c_str())));
+		return;
+	}
+
+	v8::PropertyAttribute attributes = static_cast<v8::PropertyAttribute>(v8::DontDelete | v8::ReadOnly);
+
+	v8::Handle<v8::ObjectTemplate> object = v8::ObjectTemplate::New();
+	object->SetInternalFieldCount(1);
+	object->Set(v8::String::NewSymbol("send"), v8::FunctionTemplate::New(Channel::Send), attributes);
+	object->Set(v8::String::NewSymbol("recv"), v8::FunctionTemplate::New(Channel::Receive), attributes);
+	object->Set(v8::String::NewSymbol("tryRecv"), v8::FunctionTemplate::New(Channel::TryReceive), attributes);
+	object->Set(v8::String::NewSymbol("name"), args[0], attributes);
+	object->Set(v8::String::NewSymbol("capacity"), v8::Integer::NewFromUnsigned(static_cast<uint32>(channel->buffer.Capacity())), attributes);
+
+	// Channel object keeps the channel alive (even if it is closed)
+	v8::Handle<v8::Object> instance = object->NewInstance();
+
+	Reference* reference = new Reference();
+	reference->channel = channel;
+	reference->object.Reset(isolate, instance);
+	reference->object.MakeWeak(reference, Channel::Collect);
+
+	instance->SetInternalField(0, v8::External::New(reference));
+
+	args.GetReturnValue().Set(instance);
+}
+
+// channel.close(name)
+void Channel::Close(const v8::FunctionCallbackInfo<v8::Value>& args) {
+
+	v8::HandleScope handleScope(args.GetIsolate());
+
+	if (!args.Length() || !args[0]->IsString()) {
+		v8::ThrowException(v8::Exception::TypeError(v8::String::New("Usage: channel.close(name)")));
+		return;
+	}
+
+	std::string name(*v8::String::Utf8Value(args[0]));
+	bool isClosed = false;
+
+	{
+		std::lock_guard<std::mutex> lock(channelsMutex);
+		isClosed = channels.erase(name) > 0;
+	}
+
+	if (isClosed) {
+		Metrics::Get().Add("channel.closed");
+	}
+
+	args.GetReturnValue().Set(isClosed);
+}
+
+// Channel object was garbage collected
+void Channel::Collect(v8::Isolate* isolate, v8::Persistent<v8::Object>* object, Reference* reference) {
+
+	reference->object.Dispose();
+	delete reference;
+}
+
+// channel.send(value, timeout)
+void Channel::Send(const v8::FunctionCallbackInfo<v8::Value>& args) {
+
+	v8::Isolate* isolate = args.GetIsolate();
+	v8::HandleScope handleScope(isolate);
+
+	Channel* channel = Unwrap(args);
+
+	if (channel == NULL) {
+		return;
+	}
+
+	v8::Handle<v8::Value> value = args.Length() ? args[0] : v8::Undefined().As<v8::Value>();
+
+	// Serialize before waiting (value may change while the isolate is unlocked)
+	v8::TryCatch tryCatch;
+	v8::Handle<v8::Value> json = JavaScript::CallJSON("stringify", value);
+
+	if (tryCatch.HasCaught()) {
+		tryCatch.ReThrow();
+		return;
+	}
+
+	// JSON.stringify(undefined) is undefined
+	std::string message(json->IsString() ? *v8::String::Utf8Value(json) : "null");
+
+	if (!Acquire(isolate, channel->freeCells, GetTimeout(args, 1))) {
+		args.GetReturnValue().Set(false);
+		return;
+	}
+
+	// Free cell count guarantees there is room
+	channel->buffer.Push(message);
+	ReleaseSemaphore(channel->filledCells, 1, NULL);
+
+	Metrics::Get().Add("channel.sent");
+
+	args.GetReturnValue().Set(true);
+}
+
+// channel.recv(timeout)
+void Channel::Receive(const v8::FunctionCallbackInfo<v8::Value>& args) {
+
+	v8::Isolate* isolate = args.GetIsolate();
+	v8::HandleScope handleScope(isolate);
+
+	Channel* channel = Unwrap(args);
+
+	if (channel == NULL) {
+		return;
+	}
+
+	if (!Acquire(isolate, channel->filledCells, GetTimeout(args, 0))) {
+		return;
+	}
+
+	// Filled cell count guarantees there is a value
+	std::string message;
+	channel->buffer.Pop(message);
+	ReleaseSemaphore(channel->freeCells, 1, NULL);
+
+	Metrics::Get().Add("channel.received");
+
+	args.GetReturnValue().Set(JavaScript::CallJSON("parse", v8::String::New(message.c_str())));
+}
+
+// channel.tryRecv()
+void Channel::TryReceive(const v8::FunctionCallbackInfo<v8::Value>& args) {
+
+	v8::HandleScope handleScope(args.GetIsolate());
+
+	Channel* channel = Unwrap(args);
+
+	if (channel == NULL || WaitForSingleObject(channel->filledCells, 0) != WAIT_OBJECT_0) {
+		return;
+	}
+
+	std::string message;
+	channel->buffer.Pop(message);
+	ReleaseSemaphore(channel->freeCells, 1, NULL);
+
+	Metrics::Get().Add("channel.received");
+
+	args.GetReturnValue().Set(JavaScript::CallJSON("parse", v8::String::New(message.c_str())));
+}
+
+// Get channel of a channel object
+Channel* Channel::Unwrap(const v8::FunctionCallbackInfo<v8::Value>& args) {
+
+	v8::Handle<v8::Object> self = args.This();
+
+	if (self->InternalFieldCount() < 1 || !self->GetInternalField(0)->IsExternal()) {
+		v8::ThrowException(v8::Exception::TypeError(v8::String::New("Not a channel object")));
+		return NULL;
+	}
+
+	// NOTE: Channel object (this) keeps its reference alive for the duration of the call
+	return static_cast<Reference*>(v8::Handle<v8::External>::Cast(self->GetInternalField(0))->Value())->channel.get();
+}
+
+// Wait for a semaphore count (releases the isolate lock while waiting)
+bool Channel::Acquire(v8::Isolate* isolate, HANDLE semaphore, DWORD timeout) {
+
+	// Fast path without releasing the isolate lock
+	if (WaitForSingleObject(semaphore, 0) == WAIT_OBJECT_0) {
+		return true;
+	}
+
+	if (timeout == 0) {
+		return false;
+	}
+
+	double startTime = Metrics::Now();
+
+	// Same wait as sleep() (returns early when the background script is terminated)
+	bool isAcquired = (JavaScript::Wait(isolate, semaphore, timeout) == WAIT_OBJECT_0 + 1);
+
+	Metrics::Get().Add("channel.waitTime", Metrics::Now() - startTime);
+
+	return isAcquired;
+}
+
+// Get wait timeout argument (INFINITE by default, 0 on the main thread)
+DWORD Channel::GetTimeout(const v8::FunctionCallbackInfo<v8::Value>& args, int index) {
+
+	if (args.Length() > index && args[index]->IsNumber()) {
+
+		double timeout = max(args[index]->NumberValue(), 0.0);
+
+		return static_cast<DWORD>(min(timeout, 4294967294.0));
+	}
+
+	// Main thread only waits with an explicit timeout (blocking wait would freeze the game)
+	return (std::this_thread::get_id() == Extension::Get().mainThreadID) ? 0 : INFINITE;
+}
+
+// Destructor
+Channel::~Channel() {
+
+	CloseHandle(filledCells);
+	CloseHandle(freeCells);
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+#include "RingBuffer.h"
+
+// Named message channel (bounded MPMC queue of JSON serialized values) shared by all scripts and isolates
+class Channel {
+
+public:
+
+	Channel(const std::string &name, size_t capacity);
+	~Channel();
+
+	// Register channel as a lazily installed native module
+	static void Register();
+
+	// Create channel module object (on first access)
+	static v8::Handle<v8::Value> Create();
+
+protected:
+
+	// Channel owned by a channel object (until it is garbage collected)
+	struct Reference {
+
+		shared_ptr<Channel> channel;
+		v8::Persistent<v8::Object> object;
+	};
+
+	// channel.open(name, capacity) returns a channel object (throws RangeError if an open channel has a different capacity)
+	// NOTE: Capacity is limited to 65536 values
+	static void Open(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// channel.close(name) removes a channel by name (returns false if it was not open)
+	// NOTE: Channel is freed once its channel objects are garbage collected (they keep working until then)
+	static void Close(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// channel.send(value, timeout) adds a value to the channel, waiting while it is full (returns false on timeout)
+	static void Send(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// channel.recv(timeout) removes a value from the channel, waiting while it is empty (undefined on timeout)
+	// NOTE: Without a timeout send() and recv() wait forever, except on the main thread where they never wait
+	// NOTE: Main thread gives up its lock priority while waiting, so background scripts of the same namespace can send
+	static void Receive(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// channel.tryRecv() removes a value from the channel without waiting (undefined if empty)
+	static void TryReceive(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// Get channel of a channel object
+	static Channel* Unwrap(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// Channel object was garbage collected
+	static void Collect(v8::Isolate* isolate, v8::Persistent<v8::Object>* object, Reference* reference);
+
+	// Wait for a semaphore count (releases the isolate lock while waiting)
+	static bool Acquire(v8::Isolate* isolate, HANDLE semaphore, DWORD timeout);
+
+	// Get wait timeout argument (INFINITE by default, 0 on the main thread)
+	static DWORD GetTimeout(const v8::FunctionCallbackInfo<v8::Value>& args, int index);
+
+private:
+
+	// Channel name
+	std::string name;
+
+	// Serialized values
+	RingBuffer<std::string> buffer;
+
+	// Number of filled and free buffer cells
+	HANDLE filledCells;
+	HANDLE freeCells;
+
+	// Open channels (name => channel)
+	static std::unordered_map<std::string, shared_ptr<Channel>> channels;
+	static std::mutex channelsMutex;
+};
\ No newline at end of file
@@ -0,0 +1,509 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CurlEngine.h"
+#include "Runtime.h"
+#include "EventLoop.h"
+#include "Metrics.h"
+#include "Settings.h"
+#include "ThreadScheduling.h"
+
+#include <algorithm>
+#include <chrono>
+
+// Longest wait for socket activity (in milliseconds) so that new transfers are picked up
+#define CURL_ENGINE_SELECT_TIME 50
+
+// Default number of idle easy handles kept for reuse
+#define CURL_ENGINE_HANDLES_LIMIT 8
+
+// Constructor
+CurlEngine::CurlEngine(): isStopping(false) {
+
+	curl_global_init(CURL_GLOBAL_ALL);
+	multi = curl_multi_init();
+
+	handlesLimit = static_cast<size_t>(max(Settings::Get().GetInt("Curl", "HandlePool", CURL_ENGINE_HANDLES_LIMIT), 0));
+
+	// Cookies would leak between scripts and namespaces, so sharing them is opt-in
+	isSharingCookies = Settings::Get().GetInt("Curl", "ShareCookies", 0) != 0;
+
+	share = CreateShare();
+}
+
+// Create the shared cache (NULL if libcurl refuses it)
+// NOTE: Must be called while holding the handles mutex (or from the constructor)
+CURLSH* CurlEngine::CreateShare() {
+
+	CURLSH* cache = curl_share_init();
+
+	if (cache == NULL) {
+		return NULL;
+	}
+
+	if (curl_share_setopt(cache, CURLSHOPT_LOCKFUNC, LockShare) != CURLSHE_OK ||
+		curl_share_setopt(cache, CURLSHOPT_UNLOCKFUNC, UnlockShare) != CURLSHE_OK ||
+		curl_share_setopt(cache, CURLSHOPT_USERDATA, this) != CURLSHE_OK) {
+
+		curl_share_cleanup(cache);
+		return NULL;
+	}
+
+	// Only data types libcurl accepts are reported as shared
+	// NOTE: Older libcurl builds (e.g. 7.19) refuse to share SSL sessions (handles then keep their own)
+	shared.clear();
+
+	if (curl_share_setopt(cache, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS) == CURLSHE_OK) {
+		shared.push_back("dns");
+	}
+
+	if (curl_share_setopt(cache, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION) == CURLSHE_OK) {
+		shared.push_back("sslSessions");
+	}
+
+	// Cookie engine is only enabled for new handles if cookies are shared (pooled handles would keep them otherwise)
+	if (isSharingCookies) {
+
+		if (curl_share_setopt(cache, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE) == CURLSHE_OK) {
+			shared.push_back("cookies");
+		}
+		else {
+			isSharingCookies = false;
+		}
+	}
+
+	return cache;
+}
+
+// Get an easy handle attached to the shared cache
+CURL* CurlEngine::Acquire() {
+
+	CURL* easy = NULL;
+	bool isReused = false;
+
+	{
+		std::lock_guard<std::mutex> lock(handlesMutex);
+
+		if (!handles.empty()) {
+			easy = handles.back();
+			handles.pop_back();
+			isReused = true;
+		}
+		else {
+			easy = curl_easy_init();
+		}
+
+		if (easy == NULL) {
+			return NULL;
+		}
+
+		// Shared cache is re-created after it was shed
+		if (share == NULL) {
+			share = CreateShare();
+		}
+
+		// Pooled handles are detached from the shared cache (see Release())
+		// NOTE: Attached while holding the handles mutex, so Shed() can not free the cache in between
+		if (share != NULL) {
+
+			curl_easy_setopt(easy, CURLOPT_SHARE, share);
+
+			if (isSharingCookies) {
+				curl_easy_setopt(easy, CURLOPT_COOKIEFILE, "");
+			}
+		}
+	}
+
+	Metrics::Get().Add(isReused ? "curl.handles.reused" : "curl.handles.created");
+
+	return easy;
+}
+
+// Return an easy handle to the pool
+void CurlEngine::Release(CURL* easy) {
+
+	// NOTE: curl_easy_reset() keeps the shared cache and the cookies of the handle, so both are dropped explicitly
+	// (detached first, otherwise clearing the cookie list would clear the shared cookies)
+	curl_easy_setopt(easy, CURLOPT_SHARE, NULL);
+	curl_easy_setopt(easy, CURLOPT_COOKIELIST, "ALL");
+	curl_easy_reset(easy);
+
+	{
+		std::lock_guard<std::mutex> lock(handlesMutex);
+
+		if (handles.size() < handlesLimit) {
+			handles.push_back(easy);
+			return;
+		}
+	}
+
+	curl_easy_cleanup(easy);
+}
+
+// Free idle easy handles and the shared cache (if no handle uses it)
+size_t CurlEngine::Shed() {
+
+	std::lock_guard<std::mutex> lock(handlesMutex);
+
+	size_t count = handles.size();
+
+	for (auto it = handles.begin(); it != handles.end(); ++it) {
+		curl_easy_cleanup(*it);
+	}
+
+	handles.clear();
+
+	Metrics &metrics = Metrics::Get();
+	metrics.Add("curl.handles.shed", static_cast<double>(count));
+
+	// NOTE: Refused (and kept) while running transfers or JavaScript handles are still attached to it
+	if (share != NULL && curl_share_cleanup(share) == CURLSHE_OK) {
+
+		share = NULL;
+		metrics.Add("curl.share.shed");
+	}
+
+	return count;
+}
+
+// Data types actually shared between handles (e.g. "dns", "cookies" and "sslSessions")
+std::vector<std::string> CurlEngine::GetShared() {
+
+	std::lock_guard<std::mutex> lock(handlesMutex);
+	return shared;
+}
+
+// Shared cache lock callbacks
+void CurlEngine::LockShare(CURL* easy, curl_lock_data data, curl_lock_access access, void* engine) {
+	static_cast<CurlEngine*>(engine)->shareMutexes[data].lock();
+}
+
+void CurlEngine::UnlockShare(CURL* easy, curl_lock_data data, void* engine) {
+	static_cast<CurlEngine*>(engine)->shareMutexes[data].unlock();
+}
+
+// Start a transfer of an easy handle
+bool CurlEngine::Perform(Runtime* runtime, CURL* easy, bool* isBusy, v8::Handle<v8::Function> callback, v8::Handle<v8::Value> handle) {
+
+	shared_ptr<Transfer> transfer = make_shared<Transfer>();
+
+	transfer->runtime = runtime;
+	transfer->easy = easy;
+	transfer->isBusy = isBusy;
+	transfer->callback.Reset(runtime->isolate, callback);
+	transfer->handle.Reset(runtime->isolate, handle);
+	transfer->result = CURLE_OK;
+	transfer->startTime = Metrics::Now();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (isStopping) {
+			Dispose(transfer);
+			return false;
+		}
+
+		*isBusy = true;
+
+		queued.push_back(transfer);
+		pending[runtime]++;
+
+		// Lazy start of the I/O thread on first transfer
+		if (!ioThread.joinable()) {
+			ioThread = std::thread(&CurlEngine::Loop, this);
+		}
+	}
+
+	condition.notify_one();
+
+	Metrics::Get().Add("curl.async.started");
+
+	return true;
+}
+
+// I/O thread
+void CurlEngine::Loop() {
+
+	ThreadScheduling::Apply("Curl");
+
+	Metrics &metrics = Metrics::Get();
+	std::vector<shared_ptr<Transfer>> added;
+
+	while (true) {
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			// Nothing to do (wait for new transfers)
+			while (!isStopping && queued.empty() && running.empty()) {
+				condition.wait(lock);
+			}
+
+			if (isStopping) {
+				break;
+			}
+
+			added.swap(queued);
+		}
+
+		for (auto it = added.begin(); it != added.end(); ++it) {
+
+			curl_multi_add_handle(multi, (*it)->easy);
+			running[(*it)->easy] = *it;
+		}
+
+		added.clear();
+
+		// Drive all transfers as far as they can go without blocking
+		int runningHandles = 0;
+
+		while (curl_multi_perform(multi, &runningHandles) == CURLM_CALL_MULTI_PERFORM);
+
+		// Collect finished transfers
+		CURLMsg* message;
+		int messagesLeft;
+
+		while ((message = curl_multi_info_read(multi, &messagesLeft)) != NULL) {
+
+			if (message->msg != CURLMSG_DONE) {
+				continue;
+			}
+
+			auto it = running.find(message->easy_handle);
+
+			if (it == running.end()) {
+				continue;
+			}
+
+			shared_ptr<Transfer> transfer = it->second;
+			transfer->result = message->data.result;
+
+			running.erase(it);
+			curl_multi_remove_handle(multi, transfer->easy);
+
+			metrics.Add("curl.async.completed");
+			metrics.Add("curl.async.transferTime", Metrics::Now() - transfer->startTime);
+
+			bool isFirst;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				isFirst = std::none_of(completed.begin(), completed.end(), [&](const shared_ptr<Transfer> &other) {
+					return other->runtime == transfer->runtime;
+				});
+
+				completed.push_back(transfer);
+			}
+
+			// One delivery task per runtime is enough (it drains everything completed so far)
+			if (isFirst) {
+
+				CurlEngine* engine = this;
+				Runtime* runtime = transfer->runtime;
+
+				runtime->eventLoop->Post([engine, runtime] {
+					engine->Drain(runtime);
+				});
+			}
+		}
+
+		metrics.Set("curl.async.running", (double)running.size());
+
+		if (!running.empty()) {
+
+			long timeout = -1;
+			curl_multi_timeout(multi, &timeout);
+
+			if (timeout < 0 || timeout > CURL_ENGINE_SELECT_TIME) {
+				timeout = CURL_ENGINE_SELECT_TIME;
+			}
+
+			Select(timeout);
+		}
+	}
+
+	// Abort unfinished transfers
+	for (auto it = running.begin(); it != running.end(); ++it) {
+		curl_multi_remove_handle(multi, it->first);
+	}
+}
+
+// Wait for socket activity of running transfers
+void CurlEngine::Select(long timeout) {
+
+	fd_set readSet, writeSet, errorSet;
+	int maxDescriptor = -1;
+
+	FD_ZERO(&readSet);
+	FD_ZERO(&writeSet);
+	FD_ZERO(&errorSet);
+
+	curl_multi_fdset(multi, &readSet, &writeSet, &errorSet, &maxDescriptor);
+
+	// No sockets yet (e.g. name resolving), select() fails on empty sets
+	if (maxDescriptor < 0) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(min(timeout, 10L)));
+		return;
+	}
+
+	timeval time;
+	time.tv_sec = timeout / 1000;
+	time.tv_usec = (timeout % 1000) * 1000;
+
+	select(maxDescriptor + 1, &readSet, &writeSet, &errorSet, &time);
+}
+
+// Deliver completed transfers of a runtime
+size_t CurlEngine::Drain(Runtime* runtime) {
+
+	std::vector<shared_ptr<Transfer>> delivered;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = std::stable_partition(completed.begin(), completed.end(), [&](const shared_ptr<Transfer> &transfer) {
+			return transfer->runtime != runtime;
+		});
+
+		delivered.assign(it, completed.end());
+		completed.erase(it, completed.end());
+
+		pending[runtime] -= delivered.size();
+	}
+
+	v8::Isolate* isolate = runtime->isolate;
+	v8::Local<v8::Context> context = isolate->GetCurrentContext();
+
+	Metrics &metrics = Metrics::Get();
+
+	for (auto it = delivered.begin(); it != delivered.end(); ++it) {
+
+		shared_ptr<Transfer> transfer = *it;
+
+		// Handle can be used (and performed) again from within the callback
+		*transfer->isBusy = false;
+
+		v8::HandleScope handleScope(isolate);
+		v8::Handle<v8::Value> argv[] = {
+			v8::Integer::New(transfer->result),
+			v8::Local<v8::Value>::New(isolate, transfer->handle)
+		};
+
+		{
+			v8::TryCatch tryCatch;
+
+			v8::Local<v8::Function>::New(isolate, transfer->callback)->Call(context->Global(), 2, argv);
+
+			if (tryCatch.HasCaught()) {
+				metrics.Add("curl.async.exceptions");
+			}
+		}
+
+		Dispose(transfer);
+
+		metrics.Add("curl.async.delivered");
+		metrics.Add("curl.async.deliveryTime", Metrics::Now() - transfer->startTime);
+	}
+
+	return delivered.size();
+}
+
+// Number of transfers of a runtime that are still running or not yet delivered
+size_t CurlEngine::Pending(Runtime* runtime) {
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = pending.find(runtime);
+	return it != pending.end() ? it->second : 0;
+}
+
+// Dispose JavaScript handles of a transfer
+void CurlEngine::Dispose(shared_ptr<Transfer> transfer) {
+
+	transfer->callback.Dispose();
+	transfer->callback.Clear();
+
+	transfer->handle.Dispose();
+	transfer->handle.Clear();
+}
+
+// Stop the I/O thread and release unfinished transfers
+void CurlEngine::Stop() {
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isStopping = true;
+	}
+
+	condition.notify_all();
+
+	if (ioThread.joinable()) {
+		ioThread.join();
+	}
+
+	// Collect undelivered transfers (I/O thread is done with them)
+	std::vector<shared_ptr<Transfer>> released;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		released.insert(released.end(), queued.begin(), queued.end());
+		released.insert(released.end(), completed.begin(), completed.end());
+
+		queued.clear();
+		completed.clear();
+		pending.clear();
+	}
+
+	for (auto it = running.begin(); it != running.end(); ++it) {
+		released.push_back(it->second);
+	}
+
+	running.clear();
+
+	// Persistent handles are disposed within their own isolates
+	for (auto it = released.begin(); it != released.end(); ++it) {
+
+		v8::Isolate* isolate = (*it)->runtime->isolate;
+
+		v8::Locker locker(isolate); // Critical section
+		v8::Isolate::Scope isolateScope(isolate);
+
+		Dispose(*it);
+	}
+}
+
+// Destructor
+CurlEngine::~CurlEngine() {
+
+	Stop();
+
+	curl_multi_cleanup(multi);
+
+	for (auto it = handles.begin(); it != handles.end(); ++it) {
+		curl_easy_cleanup(*it);
+	}
+
+	// NOTE: Fails (and leaks) when handles that were never destroyed still use the shared cache
+	if (share != NULL) {
+		curl_share_cleanup(share);
+	}
+	curl_global_cleanup();
+}
\ No newline at end of file
@@ -0,0 +1,143 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+
+#include <curl/curl.h>
+#include <condition_variable>
+#include <vector>
+
+class Runtime;
+
+// Process-wide libcurl state: shared DNS (and optionally cookie) cache, pooled easy handles and
+// asynchronous HTTP transfers on the multi interface (one I/O thread for all runtimes)
+// NOTE: Completion callbacks are delivered on the event loop thread of the runtime that started the transfer
+class CurlEngine {
+
+public:
+
+	CurlEngine();
+	~CurlEngine();
+
+	// Get an easy handle attached to the shared cache (reused from the pool when available)
+	CURL* Acquire();
+
+	// Return an easy handle to the pool (options and cookies are reset and the handle is detached from the shared cache, connections are kept alive)
+	void Release(CURL* easy);
+
+	// Free idle easy handles and the shared cache if no handle uses it (re-created on demand), returns the number of freed handles
+	size_t Shed();
+
+	// Data types actually shared between handles (e.g. "dns", "cookies" and "sslSessions")
+	// NOTE: Depends on what the libcurl build supports (SSL sessions are not shared by older builds)
+	std::vector<std::string> GetShared();
+
+	// Start a transfer of an easy handle, callback(status, handle) is called once it is done
+	// NOTE: Must be called while holding the isolate lock (returns false when the engine is stopped)
+	bool Perform(Runtime* runtime, CURL* easy, bool* isBusy, v8::Handle<v8::Function> callback, v8::Handle<v8::Value> handle);
+
+	// Deliver completed transfers of a runtime (returns number of called callbacks)
+	// NOTE: Must be called while holding the isolate lock (within runtime context)
+	size_t Drain(Runtime* runtime);
+
+	// Number of transfers of a runtime that are still running or not yet delivered
+	size_t Pending(Runtime* runtime);
+
+	// Stop the I/O thread and release unfinished transfers
+	// NOTE: Must not be called while holding any isolate lock
+	void Stop();
+
+protected:
+
+	// Transfer of a single easy handle
+	struct Transfer {
+
+		Runtime* runtime;
+		CURL* easy;
+
+		// Busy flag of the owning JavaScript handle (cleared on delivery)
+		bool* isBusy;
+
+		// Completion callback and the JavaScript handle passed back to it
+		v8::Persistent<v8::Function> callback;
+		v8::Persistent<v8::Value> handle;
+
+		CURLcode result;
+		double startTime;
+	};
+
+	// I/O thread
+	void Loop();
+
+	// Wait for socket activity of running transfers (up to a given time in milliseconds)
+	void Select(long timeout);
+
+	// Create the shared cache (NULL if libcurl refuses it)
+	CURLSH* CreateShare();
+
+	// Dispose JavaScript handles of a transfer
+	// NOTE: Must be called while holding the isolate lock
+	static void Dispose(shared_ptr<Transfer> transfer);
+
+	// Shared cache lock callbacks
+	static void LockShare(CURL* easy, curl_lock_data data, curl_lock_access access, void* engine);
+	static void UnlockShare(CURL* easy, curl_lock_data data, void* engine);
+
+private:
+
+	// Cache shared by all easy handles and its locks
+	// NOTE: Guarded by the handles mutex (NULL after it was shed)
+	CURLSH* share;
+	std::mutex shareMutexes[CURL_LOCK_DATA_LAST];
+
+	// Data types libcurl accepted to share
+	std::vector<std::string> shared;
+
+	// Idle easy handles and the pool size limit
+	std::vector<CURL*> handles;
+	size_t handlesLimit;
+	std::mutex handlesMutex;
+
+	// Cookie engine is enabled for new handles (cookies are shared by all requests, opt-in)
+	bool isSharingCookies;
+
+	// Multi handle driving all running transfers
+	// NOTE: Only used by the I/O thread (after it is started)
+	CURLM* multi;
+
+	// Running transfers (easy handle => transfer)
+	// NOTE: Only accessed by the I/O thread
+	std::unordered_map<CURL*, shared_ptr<Transfer>> running;
+
+	// Transfers waiting to be added to the multi handle and completed ones waiting for delivery
+	std::vector<shared_ptr<Transfer>> queued;
+	std::vector<shared_ptr<Transfer>> completed;
+
+	// Number of undelivered transfers (per runtime)
+	std::unordered_map<Runtime*, size_t> pending;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	// I/O thread
+	std::thread ioThread;
+	bool isStopping;
+};
\ No newline at end of file
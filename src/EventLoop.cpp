@@ -0,0 +1,340 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EventLoop.h"
+#include "Runtime.h"
+#include "ThreadScheduling.h"
+#include "Metrics.h"
+
+#include <chrono>
+
+// Constructor
+EventLoop::EventLoop(Runtime* runtime, int tickTime): runtime(runtime), lastID(0), tickTime(max(tickTime, 1)), isStopping(false) {
+	startTime = std::chrono::steady_clock::now();
+}
+
+// Global setTimeout(callback, delay, ...) function
+void EventLoop::SetTimeout(const v8::FunctionCallbackInfo<v8::Value>& args) {
+	Schedule(args, false, false);
+}
+
+// Global setInterval(callback, delay, ...) function
+void EventLoop::SetInterval(const v8::FunctionCallbackInfo<v8::Value>& args) {
+	Schedule(args, true, false);
+}
+
+// Global setImmediate(callback, ...) function
+void EventLoop::SetImmediate(const v8::FunctionCallbackInfo<v8::Value>& args) {
+	Schedule(args, false, true);
+}
+
+// Schedule a callback (returns timer ID)
+void EventLoop::Schedule(const v8::FunctionCallbackInfo<v8::Value>& args, bool isInterval, bool isImmediate) {
+
+	v8::Isolate* isolate = args.GetIsolate();
+
+	if (!args.Length() || !args[0]->IsFunction()) {
+		v8::ThrowException(v8::Exception::TypeError(v8::String::New("Callback must be a function")));
+		return;
+	}
+
+	Runtime* runtime = static_cast<Runtime*>(isolate->GetData());
+	EventLoop &loop = *runtime->eventLoop;
+
+	int argumentsFrom = isImmediate ? 1 : 2;
+	double delay = 0;
+
+	if (!isImmediate && args.Length() > 1 && args[1]->IsNumber()) {
+		delay = max(args[1]->NumberValue(), 0.0);
+	}
+
+	shared_ptr<Callback> callback = make_shared<Callback>();
+	callback->function.Reset(isolate, v8::Handle<v8::Function>::Cast(args[0]));
+
+	// Extra arguments are passed to the callback
+	for (int i = argumentsFrom; i < args.Length(); i++) {
+		callback->arguments.push_back(v8::Persistent<v8::Value>::New(isolate, args[i]));
+	}
+
+	// Delay is rounded up to whole ticks (at least one)
+	uint64 ticks = (uint64)((delay + loop.tickTime - 1) / loop.tickTime);
+	callback->interval = isInterval ? max(ticks, uint64(1)) : 0;
+
+	uint32 id = ++loop.lastID;
+	loop.callbacks[id] = callback;
+
+	{
+		std::lock_guard<std::mutex> lock(loop.wheelMutex);
+
+		if (isImmediate) {
+			loop.immediates.push_back(id);
+		}
+		else {
+
+			// Delay is relative to the wall clock (wheel stops ticking while the loop is idle or dispatching)
+			loop.Advance();
+			loop.wheel.Add(id, ticks);
+		}
+
+		loop.Start();
+	}
+
+	loop.wheelCondition.notify_one();
+
+	Metrics::Get().Add("eventLoop.scheduled");
+
+	args.GetReturnValue().Set(v8::Integer::NewFromUnsigned(id));
+}
+
+// Queue a native task to run while holding the isolate lock
+void EventLoop::Post(Task task) {
+
+	{
+		std::lock_guard<std::mutex> lock(wheelMutex);
+
+		tasks.push_back(task);
+		Start();
+	}
+
+	wheelCondition.notify_one();
+}
+
+// Lazy start of the event loop thread on first callback (or task)
+void EventLoop::Start() {
+
+	if (!loopThread.joinable() && !isStopping) {
+		loopThread = std::thread(&EventLoop::Loop, this);
+	}
+}
+
+// Catch the wheel up with the wall clock
+void EventLoop::Advance() {
+
+	uint64 now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count() / tickTime;
+
+	// Idle time is skipped instead of replayed
+	wheel.Skip(now);
+
+	while (wheel.Now() < now) {
+		wheel.Tick(due);
+	}
+}
+
+// Global clearTimeout(id), clearInterval(id) and clearImmediate(id) functions
+void EventLoop::Clear(const v8::FunctionCallbackInfo<v8::Value>& args) {
+
+	if (!args.Length() || !args[0]->IsNumber()) {
+		return;
+	}
+
+	Runtime* runtime = static_cast<Runtime*>(args.GetIsolate()->GetData());
+	EventLoop &loop = *runtime->eventLoop;
+
+	uint32 id = args[0]->Uint32Value();
+
+	auto it = loop.callbacks.find(id);
+
+	if (it == loop.callbacks.end()) {
+		return;
+	}
+
+	Dispose(it->second);
+	loop.callbacks.erase(it);
+
+	// NOTE: Cleared immediate IDs are skipped by the dispatcher
+	std::lock_guard<std::mutex> lock(loop.wheelMutex);
+	loop.wheel.Remove(id);
+}
+
+// Event loop thread
+void EventLoop::Loop() {
+
+	ThreadScheduling::Apply("EventLoop");
+
+	std::vector<uint32> expired;
+	std::vector<Task> posted;
+
+	while (true) {
+
+		{
+			std::unique_lock<std::mutex> lock(wheelMutex);
+
+			// Nothing to do (wait for new timers)
+			while (!isStopping && wheel.IsEmpty() && immediates.empty() && tasks.empty() && due.empty()) {
+				wheelCondition.wait(lock);
+			}
+
+			// Wait for the next tick
+			if (!isStopping && immediates.empty() && tasks.empty() && due.empty()) {
+				wheelCondition.wait_for(lock, std::chrono::milliseconds(tickTime));
+			}
+
+			if (isStopping) {
+				break;
+			}
+
+			// Catch up with the wall clock
+			Advance();
+
+			expired.swap(due);
+
+			// Immediate callbacks run before timers
+			expired.insert(expired.begin(), immediates.begin(), immediates.end());
+			immediates.clear();
+
+			posted.swap(tasks);
+		}
+
+		if (!expired.empty() || !posted.empty()) {
+
+			Dispatch(expired, posted);
+			expired.clear();
+			posted.clear();
+		}
+	}
+}
+
+// Run posted native tasks and expired timer and immediate callbacks
+void EventLoop::Dispatch(const std::vector<uint32> &expired, const std::vector<Task> &posted) {
+
+	v8::Isolate* isolate = runtime->isolate;
+
+	runtime->WaitForMainThread();
+
+	v8::Locker locker(isolate); // Critical section
+	v8::Isolate::Scope isolateScope(isolate);
+
+	runtime->SetStackLimit();
+	runtime->BackgroundLocked(true);
+
+	v8::HandleScope handleScope(isolate);
+	v8::Local<v8::Context> context = v8::Local<v8::Context>::New(isolate, runtime->context);
+	v8::Context::Scope contextScope(context);
+
+	Metrics &metrics = Metrics::Get();
+	double startTime = Metrics::Now();
+
+	// Native tasks run before callbacks (they usually complete pending I/O)
+	for (auto it = posted.begin(); it != posted.end(); ++it) {
+
+		runtime->Yield();
+
+		v8::HandleScope taskScope(isolate);
+		(*it)();
+
+		metrics.Add("eventLoop.tasks");
+	}
+
+	for (auto it = expired.begin(); it != expired.end(); ++it) {
+
+		// Callbacks are a safe point to let a waiting main thread exec run
+		runtime->Yield();
+
+		uint32 id = *it;
+		auto callbackIt = callbacks.find(id);
+
+		// Callback was cleared
+		if (callbackIt == callbacks.end()) {
+			continue;
+		}
+
+		shared_ptr<Callback> callback = callbackIt->second;
+
+		v8::HandleScope callbackScope(isolate);
+		std::vector<v8::Handle<v8::Value>> argv;
+
+		for (auto argIt = callback->arguments.begin(); argIt != callback->arguments.end(); ++argIt) {
+			argv.push_back(v8::Local<v8::Value>::New(isolate, *argIt));
+		}
+
+		{
+			v8::TryCatch tryCatch;
+
+			// TODO: Log unhandled JavaScript exceptions to ARMA RPT file
+			v8::Local<v8::Function>::New(isolate, callback->function)->Call(context->Global(), (int)argv.size(), argv.empty() ? NULL : &argv[0]);
+
+			if (tryCatch.HasCaught()) {
+				metrics.Add("eventLoop.exceptions");
+			}
+		}
+
+		metrics.Add("eventLoop.callbacks");
+
+		// Callback may have cleared itself
+		if (callbacks.find(id) == callbacks.end()) {
+			continue;
+		}
+
+		// Re-arm intervals
+		if (callback->interval > 0) {
+
+			std::lock_guard<std::mutex> lock(wheelMutex);
+
+			Advance();
+			wheel.Add(id, callback->interval);
+		}
+		else {
+
+			Dispose(callback);
+			callbacks.erase(id);
+		}
+	}
+
+	metrics.Add("eventLoop.callbackTime", Metrics::Now() - startTime);
+
+	runtime->BackgroundLocked(false);
+}
+
+// Dispose a callback
+void EventLoop::Dispose(shared_ptr<Callback> callback) {
+
+	callback->function.Dispose();
+	callback->function.Clear();
+
+	for (auto it = callback->arguments.begin(); it != callback->arguments.end(); ++it) {
+		it->Dispose();
+		it->Clear();
+	}
+}
+
+// Stop the event loop thread
+void EventLoop::Stop() {
+
+	{
+		std::lock_guard<std::mutex> lock(wheelMutex);
+		isStopping = true;
+	}
+
+	wheelCondition.notify_all();
+
+	if (loopThread.joinable()) {
+		loopThread.join();
+	}
+}
+
+// Destructor
+EventLoop::~EventLoop() {
+
+	Stop();
+
+	// Release pending callbacks
+	for (auto it = callbacks.begin(); it != callbacks.end(); ++it) {
+		Dispose(it->second);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+#include "TimerWheel.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <vector>
+
+class Runtime;
+
+// Event loop executor for timer callbacks (one thread per isolate)
+class EventLoop {
+
+public:
+
+	// Native task run on the event loop thread (within runtime context)
+	typedef std::function<void ()> Task;
+
+	EventLoop(Runtime* runtime, int tickTime);
+	~EventLoop();
+
+	// Stop the event loop thread
+	// NOTE: Must not be called while holding the isolate lock
+	void Stop();
+
+	// Queue a native task to run while holding the isolate lock (e.g. completion callbacks of native I/O)
+	// NOTE: Can be called from any thread
+	void Post(Task task);
+
+	// Global setTimeout(callback, delay, ...) function
+	static void SetTimeout(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// Global setInterval(callback, delay, ...) function
+	static void SetInterval(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// Global setImmediate(callback, ...) function
+	static void SetImmediate(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// Global clearTimeout(id), clearInterval(id) and clearImmediate(id) functions
+	static void Clear(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+protected:
+
+	// Scheduled callback
+	struct Callback {
+
+		v8::Persistent<v8::Function> function;
+		std::vector<v8::Persistent<v8::Value>> arguments;
+
+		// Repeat interval in ticks (0 for one-shot callbacks)
+		uint64 interval;
+	};
+
+	// Schedule a callback (returns timer ID)
+	// NOTE: Must be called while holding the isolate lock
+	static void Schedule(const v8::FunctionCallbackInfo<v8::Value>& args, bool isInterval, bool isImmediate);
+
+	// Event loop thread
+	void Loop();
+
+	// Run posted native tasks and expired timer and immediate callbacks
+	void Dispatch(const std::vector<uint32> &expired, const std::vector<Task> &posted);
+
+	// Lazy start of the event loop thread
+	// NOTE: Must be called while holding the wheel mutex
+	void Start();
+
+	// Catch the wheel up with the wall clock (expired timers are kept for the event loop thread)
+	// NOTE: Must be called while holding the wheel mutex
+	void Advance();
+
+	// Dispose a callback
+	static void Dispose(shared_ptr<Callback> callback);
+
+private:
+
+	// Runtime (isolate and context) the callbacks are running in
+	Runtime* runtime;
+
+	// Scheduled callbacks (timer ID => callback)
+	// NOTE: Only accessed while holding the isolate lock
+	std::unordered_map<uint32, shared_ptr<Callback>> callbacks;
+
+	// Last timer ID
+	uint32 lastID;
+
+	// Pending timers and immediate callbacks
+	TimerWheel wheel;
+	std::deque<uint32> immediates;
+
+	// Timers expired by Advance() but not dispatched yet
+	std::vector<uint32> due;
+
+	// Time of wheel tick 0
+	std::chrono::steady_clock::time_point startTime;
+	std::vector<Task> tasks;
+	std::mutex wheelMutex;
+	std::condition_variable wheelCondition;
+
+	// Timer wheel tick length (in milliseconds)
+	int tickTime;
+
+	// Event loop thread
+	std::thread loopThread;
+	bool isStopping;
+};
\ No newline at end of file
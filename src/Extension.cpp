@@ -21,6 +21,44 @@
 #include "SQF.h"
 #include "JavaScript.h"
 #include "LibCurlJSAPI.h"
+#include "Runtime.h"
+#include "SandboxPool.h"
+#include "ThreadPool.h"
+#include "ThreadScheduling.h"
+#include "EventLoop.h"
+#include "WorkerPool.h"
+#include "NativeKernels.h"
+#include "CurlEngine.h"
+#include "Watchdog.h"
+#include "ScriptTable.h"
+#include "Channel.h"
+#include "BackgroundScript.h"
+#include "Natives.h"
+#include "ArrayBufferAllocator.h"
+#include "Metrics.h"
+#include "Settings.h"
+
+#include <chrono>
+
+// Default number of background script worker threads
+#define EXTENSION_SPAWN_THREADS 16
+
+// Default limit of worker and spare threads (spare ones run scripts while others are blocked in sleep, recv or HTTP transfers)
+#define EXTENSION_SPAWN_MAX_THREADS 256
+
+// Default priority aging time of background scripts (in milliseconds)
+#define EXTENSION_SPAWN_AGING_TIME 100
+
+// Default number of background script slots (active script handles)
+#define EXTENSION_SPAWN_MAX_SCRIPTS 65536
+
+// Spawn overflow policies (when all worker threads are busy)
+#define EXTENSION_SPAWN_OVERFLOW_QUEUE 0
+#define EXTENSION_SPAWN_OVERFLOW_REJECT 1
+#define EXTENSION_SPAWN_OVERFLOW_COALESCE 2
+
+// Background script running on the current worker thread
+__declspec(thread) static BackgroundScript* currentScript = NULL;
 
 // DLL entry point
 BOOL WINAPI DllMain(HMODULE hModule, DWORD fdwReason, LPVOID lpvReserved) {
@@ -74,38 +112,158 @@ void __stdcall RVExtension(char* output, int outputSize, const char* input) {
 }
 
 // Constructor
-Extension::Extension(): isolate(NULL) {
+Extension::Extension(): lastGroupID(0), spawnAgingTime(0), spawnThreads(0), spawnMaxQueued(0), spawnOverflow(EXTENSION_SPAWN_OVERFLOW_QUEUE), spawnQueued(0), execTimeout(0) {
 
 	// Main execution thread ID is used for sleep/uiSleep constrain checks
 	mainThreadID = std::this_thread::get_id();
 
-	// Single (default) isolated V8 instance is used.
-	// TODO: Consider using separate isolates for each ARMA addon (based on PBO prefix?)
-	isolate = v8::Isolate::GetCurrent();
-
-	v8::HandleScope handleScope(isolate);
-	v8::PropertyAttribute builtInPropAttr = (v8::PropertyAttribute)(v8::DontDelete | v8::ReadOnly);
-
-	// Create a template for the global object
-	v8::Handle<v8::ObjectTemplate> global = v8::ObjectTemplate::New();
+	// Native modules are installed lazily (created on first access)
+	Natives &natives = Natives::Get();
 
 	// sleep() function
-	global->Set(v8::String::NewSymbol("sleep"), v8::FunctionTemplate::New(JavaScript::Sleep), builtInPropAttr);
+	natives.Register("sleep", JavaScript::Sleep);
+
+	// Timer functions (executed by the runtime event loop)
+	natives.Register("setTimeout", EventLoop::SetTimeout);
+	natives.Register("setInterval", EventLoop::SetInterval);
+	natives.Register("setImmediate", EventLoop::SetImmediate);
+	natives.Register("clearTimeout", EventLoop::Clear);
+	natives.Register("clearInterval", EventLoop::Clear);
+	natives.Register("clearImmediate", EventLoop::Clear);
+	natives.Register("lowMemory", JavaScript::LowMemory);
 
 	// TODO: Add "global" property as alias for global object
 	// TODO: Add JavaScript log() function to log to ARMA RPT file
-	// TODO: Detect when ARMA is paused (suspend background scripts and use v8::V8::IdleNotification())
 
-	LibCurlJSAPI::Register(global);
-	
-	// Create V8 execution context
-	context.Reset(isolate, v8::Context::New(isolate, NULL, global));
+	LibCurlJSAPI::Register();
+
+	// parallel.map() on worker isolates
+	WorkerPool::Register();
+
+	// Numeric typed array kernels (outside the isolate lock)
+	NativeKernels::Register();
+
+	// Message channels between scripts
+	Channel::Register();
+
+	// Extra V8 flags (e.g. GC tuning) must be set before any isolate is used
+	std::string flags = Settings::Get().GetString("V8", "Flags", "");
+
+	if (!flags.empty()) {
+		v8::V8::SetFlagsFromString(flags.c_str(), (int)flags.size());
+	}
+
+	// Typed arrays (and native kernel results) need an ArrayBuffer allocator before any isolate is used
+	static ArrayBufferAllocator arrayBufferAllocator;
+	v8::V8::SetArrayBufferAllocator(&arrayBufferAllocator);
+
+	// Default (single) V8 isolate is used unless a namespace is given
+	defaultRuntime.reset(new Runtime(""));
+
+	// Background script worker threads
+	spawnThreads = static_cast<uint32>(max(Settings::Get().GetInt("Spawn", "Threads", EXTENSION_SPAWN_THREADS), 1));
+	spawnAgingTime = max(Settings::Get().GetInt("Spawn", "AgingTime", EXTENSION_SPAWN_AGING_TIME), 0);
+	size_t spawnMaxThreads = static_cast<size_t>(max(Settings::Get().GetInt("Spawn", "MaxThreads", EXTENSION_SPAWN_MAX_THREADS), static_cast<int>(spawnThreads)));
+	spawnPool.reset(new ThreadPool(spawnThreads, spawnAgingTime, std::bind(ThreadScheduling::Apply, "Spawn"), spawnMaxThreads));
+
+	// Admission control (what happens to new scripts when all worker threads are busy)
+	spawnMaxQueued = static_cast<uint32>(max(Settings::Get().GetInt("Spawn", "MaxQueued", 0), 0));
+
+	std::string overflow = Settings::Get().GetString("Spawn", "Overflow", "queue");
+
+	if (_stricmp(overflow.c_str(), "reject") == 0) {
+		spawnOverflow = EXTENSION_SPAWN_OVERFLOW_REJECT;
+	}
+	else if (_stricmp(overflow.c_str(), "coalesce") == 0) {
+		spawnOverflow = EXTENSION_SPAWN_OVERFLOW_COALESCE;
+	}
+
+	// Admission settings are reported with metrics (e.g. tests check the reject and coalesce paths)
+	Metrics &metrics = Metrics::Get();
+	metrics.Set("spawn.threads", spawnThreads);
+	metrics.Set("spawn.maxThreads", static_cast<double>(spawnMaxThreads));
+	metrics.Set("spawn.maxQueued", spawnMaxQueued);
+	metrics.Set("spawn.overflow", spawnOverflow);
+
+	// Active background script slots (limits the number of queued and running scripts)
+	int maxScripts = Settings::Get().GetInt("Spawn", "MaxScripts", EXTENSION_SPAWN_MAX_SCRIPTS);
+	backgroundScripts.reset(new ScriptTable(static_cast<uint32>(max(maxScripts, 1))));
+
+	// Worker isolate threads (one per CPU core by default)
+	int parallelThreads = Settings::Get().GetInt("Parallel", "Threads", 0);
+
+	if (parallelThreads <= 0) {
+		parallelThreads = max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+	}
+
+	workerPool.reset(new WorkerPool(parallelThreads));
+
+	// Asynchronous HTTP transfers (I/O thread starts on the first transfer)
+	curlEngine.reset(new CurlEngine());
+
+	// Default time budget for JS_fnc_exec (can be overridden per call)
+	execTimeout = max(Settings::Get().GetInt("Exec", "Timeout", 0), 0);
+	watchdog.reset(new Watchdog());
 }
 
 // Run JavaScript code and return the result as SQF output
 std::string Extension::Run(const char* input) {
 
+	// Namespaced protocol command (separate V8 isolate for each ARMA addon)
+	if (input[0] == JS_PROTOCOL_COMMAND && input[1] == JS_PROTOCOL_TOKEN_NAMESPACE) {
+
+		const char* separator = strchr(input + JS_PROTOCOL_LENGTH, JS_PROTOCOL_NAMESPACE_SEPARATOR);
+
+		// Invalid namespace command
+		if (separator == NULL) {
+			return SQF::Throw("[NS]");
+		}
+
+		std::string name(input + JS_PROTOCOL_LENGTH, separator);
+
+		if (!name.empty()) {
+
+			Runtime* runtime = GetRuntime(name);
+
+			if (runtime == NULL) {
+				return SQF::Nil; // System error
+			}
+
+			return Run(runtime, separator + 1);
+		}
+
+		input = separator + 1;
+	}
+
+	return Run(defaultRuntime.get(), input);
+}
+
+// Run JavaScript code and return the result as SQF output (within a given runtime)
+std::string Extension::Run(Runtime* runtime, const char* input) {
+
 	bool isSpawn = false;
+	bool isSandbox = false;
+	bool isGroup = false;
+
+	// JavaScript code offset (after the protocol command) and spawn priority class
+	size_t codeOffset = 0;
+	int priority = JS_PRIORITY_NORMAL;
+
+	int timeout = execTimeout;
+
+	// Time budget override ("#B<milliseconds>:<payload>")
+	if (input[0] == JS_PROTOCOL_COMMAND && input[1] == JS_PROTOCOL_TOKEN_BUDGET) {
+
+		const char* separator = strchr(input + JS_PROTOCOL_LENGTH, JS_PROTOCOL_BUDGET_SEPARATOR);
+
+		// Invalid time budget command
+		if (separator == NULL) {
+			return SQF::Throw("[TB]");
+		}
+
+		timeout = max(atoi(input + JS_PROTOCOL_LENGTH), 0);
+		input = separator + 1;
+	}
 
 	// Fast path to process special protocol commands
 	if (input[0] == JS_PROTOCOL_COMMAND && input[1] != '\0') {
@@ -113,43 +271,66 @@ std::string Extension::Run(const char* input) {
 		// JS_fnc_spawn
 		if (input[1] == JS_PROTOCOL_TOKEN_SPAWN) {
 			isSpawn = true;
+			codeOffset = JS_PROTOCOL_LENGTH;
+		}
+		// JS_fnc_spawn (with a priority class)
+		else if (input[1] == JS_PROTOCOL_TOKEN_SPAWN_PRIORITY && input[2] != '\0') {
+			isSpawn = true;
+			codeOffset = JS_PROTOCOL_LENGTH + 1;
+			priority = min(max(input[2] - '0', JS_PRIORITY_HIGH), JS_PRIORITY_LOW);
+		}
+		// JS_fnc_spawnGroup
+		else if (input[1] == JS_PROTOCOL_TOKEN_SPAWN_GROUP) {
+			isGroup = true;
+			codeOffset = JS_PROTOCOL_LENGTH;
+		}
+		// JS_fnc_exec (within a pooled sandbox context)
+		else if (input[1] == JS_PROTOCOL_TOKEN_SANDBOX) {
+			isSandbox = true;
+			codeOffset = JS_PROTOCOL_LENGTH;
 		}
 		// JS_fnc_terminate
 		else if (input[1] == JS_PROTOCOL_TOKEN_TERMINATE) {
-			
-			std::string scriptHandle(input + JS_PROTOCOL_LENGTH);
-			auto result = SQF::False;
 
-			backgroundScriptsMutex.lock();
+			uint32 groupID = GetGroupID(input + JS_PROTOCOL_LENGTH);
 
-			auto it = backgroundScripts.find(scriptHandle);
+			if (groupID != 0) {
+				return TerminateGroup(groupID, 0) ? SQF::True : SQF::False;
+			}
 
-			if (it != backgroundScripts.end()) {
+			uint32 scriptID = ScriptTable::FromHandle(input + JS_PROTOCOL_LENGTH);
 
-				// Signal script termination event
-				SetEvent(it->second);
+			return Terminate(scriptID, 0) ? SQF::True : SQF::False;
+		}
+		// JS_fnc_terminate (blocking, "#W<milliseconds>:<script or group handle>")
+		else if (input[1] == JS_PROTOCOL_TOKEN_TERMINATE_WAIT) {
 
-				// TODO: Should we block and wait until the background script is terminated?
+			const char* separator = strchr(input + JS_PROTOCOL_LENGTH, JS_PROTOCOL_BUDGET_SEPARATOR);
 
-				result = SQF::True;
+			// Invalid terminate command
+			if (separator == NULL) {
+				return SQF::Throw("[TW]");
 			}
 
-			backgroundScriptsMutex.unlock();
+			uint32 groupID = GetGroupID(separator + 1);
+			uint32 scriptID = ScriptTable::FromHandle(separator + 1);
+			int timeout = max(atoi(input + JS_PROTOCOL_LENGTH), 1);
 
-			return result;
+			if (groupID != 0) {
+				return TerminateGroup(groupID, timeout) ? SQF::True : SQF::False;
+			}
+
+			return Terminate(scriptID, timeout) ? SQF::True : SQF::False;
 		}
 		// JS_fnc_done
 		else if (input[1] == JS_PROTOCOL_TOKEN_DONE) {
 			
-			std::string scriptHandle(input + JS_PROTOCOL_LENGTH);
 			auto result = SQF::False;
 
 			backgroundScriptsMutex.lock();
 
-			auto it = backgroundScripts.find(scriptHandle);
-
-			// Background script is finished (or invalid script handle)
-			if (it == backgroundScripts.end()) {
+			// Background script (or all scripts of a group) is finished (or stale/invalid handle)
+			if (IsDone(input + JS_PROTOCOL_LENGTH, false)) {
 				result = SQF::True;
 			}
 
@@ -157,6 +338,52 @@ std::string Extension::Run(const char* input) {
 
 			return result;
 		}
+		// JS_fnc_wait ("#J<milliseconds>:<handle>" or "#Y<milliseconds>:<handle>")
+		else if (input[1] == JS_PROTOCOL_TOKEN_WAIT_ALL || input[1] == JS_PROTOCOL_TOKEN_WAIT_ANY) {
+
+			const char* separator = strchr(input + JS_PROTOCOL_LENGTH, JS_PROTOCOL_BUDGET_SEPARATOR);
+
+			// Invalid wait command
+			if (separator == NULL) {
+				return SQF::Throw("[WT]");
+			}
+
+			int timeout = max(atoi(input + JS_PROTOCOL_LENGTH), 0);
+			bool isAny = (input[1] == JS_PROTOCOL_TOKEN_WAIT_ANY);
+
+			return Wait(separator + 1, timeout, isAny) ? SQF::True : SQF::False;
+		}
+		// JS_fnc_stats
+		else if (input[1] == JS_PROTOCOL_TOKEN_STATS) {
+
+			uint32 scriptID = ScriptTable::FromHandle(input + JS_PROTOCOL_LENGTH);
+			std::string result(SQF::Nil);
+
+			backgroundScriptsMutex.lock();
+
+			BackgroundScript* backgroundScript = backgroundScripts->Find(scriptID);
+
+			// Running (or queued) script wall and CPU time in milliseconds
+			if (backgroundScript != NULL) {
+
+				double runTime = 0;
+				double cpuTime = 0;
+
+				if (backgroundScript->thread != NULL) {
+					runTime = Metrics::Now() - backgroundScript->startTime;
+					cpuTime = Metrics::ThreadTime(backgroundScript->thread) - backgroundScript->startThreadTime;
+				}
+
+				std::stringstream sqf;
+				sqf << "[" << runTime / 1000 << "," << cpuTime / 1000 << "]";
+
+				result = sqf.str();
+			}
+
+			backgroundScriptsMutex.unlock();
+
+			return result;
+		}
 		// JS_fnc_version
 		else if (input[1] == JS_PROTOCOL_TOKEN_VERSION) {
 
@@ -177,6 +404,40 @@ std::string Extension::Run(const char* input) {
 
 			return sqf;
 		}
+		// JS_fnc_idle ("#L<milliseconds>")
+		else if (input[1] == JS_PROTOCOL_TOKEN_IDLE) {
+
+			int idleTime = max(atoi(input + JS_PROTOCOL_LENGTH), 0);
+
+			return runtime->Idle(idleTime) ? SQF::True : SQF::False;
+		}
+		// JS_fnc_lowMemory
+		else if (input[1] == JS_PROTOCOL_TOKEN_LOW_MEMORY) {
+
+			size_t usedBefore;
+			size_t usedAfter;
+
+			{
+				Runtime::MainThreadScope mainThreadScope(runtime);
+
+				v8::Locker locker(runtime->isolate); // Critical section
+				v8::Isolate::Scope isolateScope(runtime->isolate);
+
+				mainThreadScope.Locked();
+
+				runtime->Compact(usedBefore, usedAfter);
+			}
+
+			// Used heap size in bytes before and after
+			std::stringstream sqf;
+			sqf << "[" << static_cast<double>(usedBefore) << "," << static_cast<double>(usedAfter) << "]";
+
+			return sqf.str();
+		}
+		// JS_fnc_metrics
+		else if (input[1] == JS_PROTOCOL_TOKEN_METRICS) {
+			return Metrics::Get().ToSQF();
+		}
 		// JS_fnc_init
 		else if (input[1] == JS_PROTOCOL_TOKEN_INIT) {
 			
@@ -185,23 +446,67 @@ std::string Extension::Run(const char* input) {
 		}
 	}
 
+	// Identical script that is still queued is reused (no need to compile and queue it again)
+	std::string coalesceKey;
+
+	if (isSpawn && spawnOverflow == EXTENSION_SPAWN_OVERFLOW_COALESCE) {
+
+		coalesceKey = runtime->name + JS_PROTOCOL_STRING_NAMESPACE_SEPARATOR + (input + codeOffset);
+
+		std::lock_guard<std::mutex> lock(backgroundScriptsMutex);
+
+		auto it = spawnQueuedSources.find(coalesceKey);
+
+		if (it != spawnQueuedSources.end()) {
+
+			Metrics::Get().Add("spawn.coalesced");
+
+			return SQF::String(ScriptTable::ToHandle(it->second));
+		}
+	}
+
+	v8::Isolate* isolate = runtime->isolate;
+
+	// Background scripts yield the isolate lock to the main thread (until this exec is done)
+	Runtime::MainThreadScope mainThreadScope(runtime);
+
 	v8::Locker locker(isolate); // Critical section
 	v8::Isolate::Scope isolateScope(isolate);
+
+	mainThreadScope.Locked();
+
+	runtime->SetStackLimit();
+
 	v8::HandleScope handleScope(isolate);
-	v8::Context::Scope contextScope(v8::Local<v8::Context>::New(isolate, context));
 
-	v8::Handle<v8::String> source;
+	// Sandbox context has separate globals (but shares the isolate and its compiled code)
+	shared_ptr<SandboxPool::Sandbox> sandbox;
+	v8::Local<v8::Context> context;
 
-	if (isSpawn) {
-		source = v8::String::NewFromUtf8(isolate, input + JS_PROTOCOL_LENGTH);
+	if (isSandbox) {
+		sandbox = runtime->sandboxes->Acquire();
+		context = v8::Local<v8::Context>::New(isolate, sandbox->context);
 	}
 	else {
-		source = v8::String::NewFromUtf8(isolate, input);
+		context = v8::Local<v8::Context>::New(isolate, runtime->context);
+	}
+
+	v8::Context::Scope contextScope(context);
+
+	// JS_fnc_spawnGroup
+	if (isGroup) {
+		return SpawnGroup(runtime, input + codeOffset);
 	}
 
+	std::string sqf(SQF::Nil);
+	v8::Handle<v8::String> source;
+
+	source = v8::String::NewFromUtf8(isolate, input + codeOffset);
+
 	if (!source.IsEmpty()) {
 
 		v8::TryCatch tryCatch;
+		bool isTimeout = false;
 
 		v8::Handle<v8::Script> script = v8::Script::Compile(source);
 		v8::Handle<v8::Value> result;
@@ -212,92 +517,645 @@ std::string Extension::Run(const char* input) {
 			// Parallel JS_fnc_spawn support
 			if (isSpawn) {
 
-				// NOTE: The persistent V8 Script handle will be released by the background thread
-				v8::Persistent<v8::Script> backgroundScript = v8::Persistent<v8::Script>::New(isolate, script);
+				shared_ptr<BackgroundScript> backgroundScript = make_shared<BackgroundScript>();
+
+				backgroundScript->runtime = runtime;
+				backgroundScript->priority = priority;
+				backgroundScript->terminationEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+				backgroundScript->queueTime = Metrics::Now();
 
-				try {
+				if (backgroundScript->terminationEvent == NULL) {
+					return SQF::Nil; // System error
+				}
 
-					// TODO: Use background script thread pool
-					// (or rewrite with std::async as MSVC 11 STL is using thread pooling internally)
-					std::thread backgroundThread(Extension::Spawn, backgroundScript);
+				backgroundScriptsMutex.lock();
 
-					std::string scriptHandle = GetScriptHandle(backgroundThread.get_id());
+				// Store background script in a free slot (generation makes stale handles invalid)
+				if (CanQueue(1)) {
 
-					// Store background script handle and termination event
-					backgroundScriptsMutex.lock();
-					backgroundScripts[scriptHandle] = CreateEvent(NULL, TRUE, FALSE, NULL);
-					backgroundScriptsMutex.unlock();
+					backgroundScript->id = backgroundScripts->Add(backgroundScript);
+					backgroundScript->coalesceKey = coalesceKey;
 
-					backgroundThread.detach();
+					if (!coalesceKey.empty()) {
+						spawnQueuedSources[coalesceKey] = backgroundScript->id;
+					}
 
-					return SQF::String(scriptHandle);
+					UpdateQueued(1);
 				}
-				catch (...) {
-					return SQF::Nil; // System error
+
+				backgroundScriptsMutex.unlock();
+
+				// Rejected by admission control (or all script slots are in use)
+				if (backgroundScript->id == 0) {
+
+					Metrics::Get().Add("spawn.rejected");
+
+					return SQF::False;
 				}
+
+				// NOTE: The persistent V8 Script handle will be released by the worker thread
+				backgroundScript->script.Reset(isolate, script);
+
+				// Run in the background script worker pool
+				spawnPool->Post(std::bind(Extension::Spawn, backgroundScript), priority);
+
+				return SQF::String(ScriptTable::ToHandle(backgroundScript->id));
 			}
 			// JS_fnc_exec
 			else {
+
+				uint64 deadlineID = (timeout > 0) ? watchdog->Arm(isolate, timeout) : 0;
+
 				result = script->Run();
+
+				// Time budget ran out (watchdog terminated the script)
+				if (deadlineID > 0 && watchdog->Disarm(deadlineID)) {
+					isTimeout = true;
+				}
 			}
 		}
 
+		// Terminated script must leave the isolate usable for the next call
+		if (isTimeout) {
+
+			v8::V8::CancelTerminateExecution(isolate);
+
+			std::stringstream message;
+			message << "Execution time budget of " << timeout << " ms exceeded";
+
+			sqf = SQF::Throw(message.str());
+		}
 		// Process unhandled script exceptions
-		if (tryCatch.HasCaught()) {
+		else if (tryCatch.HasCaught()) {
 
 			// Use SQF exception handling to report JavaScript errors
-			return SQF::Throw(GetException(tryCatch));
+			sqf = SQF::Throw(GetException(tryCatch));
 		}
 		else if (!result.IsEmpty()) {
 
 			// Return JavaScript result as serialized SQF
-			return JavaScript::ToSQF(result);
+			sqf = JavaScript::ToSQF(result);
 		}
 	}
 
-	return SQF::Nil;
+	// Return sandbox context to the pool
+	if (sandbox) {
+		runtime->sandboxes->Release(sandbox);
+	}
+
+	// Heap growth past the memory watermark triggers compaction
+	runtime->CheckMemory();
+
+	return sqf;
 }
 
 // Run JavaScript code in parallel (non-blocking mode)
-void Extension::Spawn(v8::Persistent<v8::Script> script) {
+void Extension::Spawn(shared_ptr<BackgroundScript> backgroundScript) {
 
 	Extension &extension = Extension::Get();
+	Runtime* runtime = backgroundScript->runtime;
 
-	v8::Locker locker(extension.isolate); // Critical section
+	Metrics &metrics = Metrics::Get();
 
-	v8::Isolate::Scope isolateScope(extension.isolate);
-	v8::HandleScope handleScope(extension.isolate);
-	v8::Context::Scope contextScope(v8::Local<v8::Context>::New(extension.isolate, extension.context));
+	// Queue latency (also per priority class)
+	double queueTime = Metrics::Now() - backgroundScript->queueTime;
+	std::string priorityName(GetPriorityName(backgroundScript->priority));
 
-	v8::TryCatch tryCatch;
+	metrics.Add("spawn.queueTime", queueTime);
+	metrics.Add("spawn." + priorityName + ".count");
+	metrics.Add("spawn." + priorityName + ".queueTime", queueTime);
+	metrics.Max("spawn." + priorityName + ".queueTimeMax", queueTime);
 
-	// TODO: Catch and log unhandled JavaScript exceptions to ARMA RPT file
-	script->Run();
+	// Script state used by sleep() (worker threads are reused between scripts)
+	currentScript = backgroundScript.get();
 
-	std::string scriptHandle = GetScriptHandle(std::this_thread::get_id());
+	// Fairness accounting (wall and CPU time of the worker thread)
+	HANDLE thread = NULL;
+	DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &thread, 0, FALSE, DUPLICATE_SAME_ACCESS);
 
 	extension.backgroundScriptsMutex.lock();
 
-	auto it = extension.backgroundScripts.find(scriptHandle);
+	backgroundScript->thread = thread;
+	backgroundScript->startTime = Metrics::Now();
+	backgroundScript->startThreadTime = Metrics::ThreadTime(thread);
+
+	// Running script can no longer be coalesced with new ones
+	if (!backgroundScript->coalesceKey.empty()) {
+
+		auto it = extension.spawnQueuedSources.find(backgroundScript->coalesceKey);
+
+		if (it != extension.spawnQueuedSources.end() && it->second == backgroundScript->id) {
+			extension.spawnQueuedSources.erase(it);
+		}
+	}
+
+	extension.UpdateQueued(-1);
+
+	extension.backgroundScriptsMutex.unlock();
+
+	// Higher priority scripts (and the main thread) get the isolate lock first
+	double lockTime = Metrics::Now();
+
+	runtime->WaitForTurn(backgroundScript->priority, extension.spawnAgingTime);
+
+	{
+		v8::Locker locker(runtime->isolate); // Critical section
+
+		runtime->TurnTaken(backgroundScript->priority);
+		metrics.Add("spawn." + priorityName + ".lockTime", Metrics::Now() - lockTime);
+
+		v8::Isolate::Scope isolateScope(runtime->isolate);
+
+		runtime->SetStackLimit();
+
+		v8::HandleScope handleScope(runtime->isolate);
+		v8::Local<v8::Context> context = v8::Local<v8::Context>::New(runtime->isolate, runtime->context);
+		v8::Context::Scope contextScope(context);
+
+		backgroundScript->threadID = v8::V8::GetCurrentThreadId();
+
+		// Script terminated while queued will stop right away
+		SetScriptRunning(true);
+
+		{
+			v8::TryCatch tryCatch;
+
+			// TODO: Catch and log unhandled JavaScript exceptions to ARMA RPT file
+			if (!backgroundScript->function.IsEmpty()) {
+
+				// Spawn group function (argument array is spread, other values are passed as is)
+				v8::Local<v8::Value> arguments = v8::Local<v8::Value>::New(runtime->isolate, backgroundScript->arguments);
+				std::vector<v8::Handle<v8::Value>> argv;
+
+				if (arguments->IsArray()) {
+
+					v8::Local<v8::Array> array = v8::Local<v8::Array>::Cast(arguments);
+
+					for (uint32 i = 0; i < array->Length(); i++) {
+						argv.push_back(array->Get(i));
+					}
+				}
+				else {
+					argv.push_back(arguments);
+				}
+
+				v8::Local<v8::Function>::New(runtime->isolate, backgroundScript->function)->Call(context->Global(), static_cast<int>(argv.size()), argv.empty() ? NULL : &argv[0]);
+			}
+			else {
+				v8::Local<v8::Script>::New(runtime->isolate, backgroundScript->script)->Run();
+			}
+		}
+
+		SetScriptRunning(false);
+
+		// Terminated script must not affect the next script on this worker thread
+		if (v8::V8::IsExecutionTerminating(runtime->isolate)) {
+			v8::V8::CancelTerminateExecution(runtime->isolate);
+		}
+
+		// Dispose persistent script (or group function and its arguments) handles
+		backgroundScript->script.Dispose();
+		backgroundScript->script.Clear();
+		backgroundScript->function.Dispose();
+		backgroundScript->function.Clear();
+		backgroundScript->arguments.Dispose();
+		backgroundScript->arguments.Clear();
+
+		runtime->CheckMemory();
+	}
+
+	currentScript = NULL;
+
+	double runTime = Metrics::Now() - backgroundScript->startTime;
+	double cpuTime = Metrics::ThreadTime(thread) - backgroundScript->startThreadTime;
+
+	extension.backgroundScriptsMutex.lock();
 
 	// Clean up
-	if (it != extension.backgroundScripts.end()) {
+	extension.backgroundScripts->Remove(backgroundScript->id);
 
-		CloseHandle(it->second);
-		extension.backgroundScripts.erase(scriptHandle);
+	if (thread != NULL) {
+		CloseHandle(thread);
+		backgroundScript->thread = NULL;
+	}
+
+	// Group is released with its last script
+	if (backgroundScript->groupID != 0) {
+
+		auto it = extension.scriptGroups.find(backgroundScript->groupID);
+
+		if (it != extension.scriptGroups.end() && --it->second->live == 0) {
+			extension.scriptGroups.erase(it);
+		}
 	}
 
 	extension.backgroundScriptsMutex.unlock();
+	extension.backgroundScriptsCondition.notify_all();
+
+	metrics.Add("spawn.count");
+	metrics.Add("spawn.runTime", runTime);
+	metrics.Add("spawn.cpuTime", cpuTime);
+	metrics.Max("spawn.cpuTimeMax", cpuTime);
+}
+
+// Run multiple scripts (or one function with multiple argument sets) in the background as a group
+std::string Extension::SpawnGroup(Runtime* runtime, const char* payload) {
+
+	v8::Isolate* isolate = runtime->isolate;
+	v8::TryCatch tryCatch;
+
+	// Compiled group scripts or a shared function and its argument sets
+	std::vector<v8::Handle<v8::Script>> scripts;
+	v8::Handle<v8::Function> function;
+	v8::Handle<v8::Array> argumentSets;
+
+	const char* argumentsSeparator = strchr(payload, JS_PROTOCOL_GROUP_ARGUMENTS_SEPARATOR);
+
+	// One function compiled once and called with each argument set
+	if (argumentsSeparator != NULL) {
+
+		std::string functionSource("(");
+		functionSource.append(payload, argumentsSeparator);
+		functionSource += ")";
+
+		v8::Handle<v8::Script> functionScript = v8::Script::Compile(v8::String::NewFromUtf8(isolate, functionSource.c_str()));
+
+		v8::Handle<v8::Value> functionValue;
+		v8::Handle<v8::Value> argumentsValue;
+
+		if (!functionScript.IsEmpty()) {
+			functionValue = functionScript->Run();
+		}
+
+		// Argument sets are JSON (serialized by JS_fnc_json), never evaluated as code
+		if (!functionValue.IsEmpty()) {
+			argumentsValue = JavaScript::CallJSON("parse", v8::String::NewFromUtf8(isolate, argumentsSeparator + 1));
+		}
+
+		if (tryCatch.HasCaught()) {
+			return SQF::Throw(GetException(tryCatch));
+		}
+
+		if (functionValue.IsEmpty() || !functionValue->IsFunction() || argumentsValue.IsEmpty() || !argumentsValue->IsArray()) {
+			return SQF::Throw("Invalid spawn group function or arguments");
+		}
+
+		function = v8::Handle<v8::Function>::Cast(functionValue);
+		argumentSets = v8::Handle<v8::Array>::Cast(argumentsValue);
+	}
+	// Separate scripts
+	else {
+
+		const char* source = payload;
+
+		while (true) {
+
+			const char* separator = strchr(source, JS_PROTOCOL_GROUP_SEPARATOR);
+			std::string code = (separator != NULL) ? std::string(source, separator) : std::string(source);
+
+			v8::Handle<v8::Script> script = v8::Script::Compile(v8::String::NewFromUtf8(isolate, code.c_str()));
+
+			if (script.IsEmpty()) {
+				return SQF::Throw(GetException(tryCatch));
+			}
+
+			scripts.push_back(script);
+
+			if (separator == NULL) {
+				break;
+			}
+
+			source = separator + 1;
+		}
+	}
+
+	uint32 count = function.IsEmpty() ? static_cast<uint32>(scripts.size()) : argumentSets->Length();
+
+	std::vector<shared_ptr<BackgroundScript>> group;
+	bool isCreated = true;
+
+	for (uint32 i = 0; i < count; i++) {
+
+		shared_ptr<BackgroundScript> backgroundScript = make_shared<BackgroundScript>();
+
+		backgroundScript->runtime = runtime;
+		backgroundScript->terminationEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+		backgroundScript->queueTime = Metrics::Now();
+
+		if (backgroundScript->terminationEvent == NULL) {
+			isCreated = false;
+			break;
+		}
+
+		group.push_back(backgroundScript);
+	}
+
+	backgroundScriptsMutex.lock();
+
+	// The whole group is rejected by admission control (or if there are not enough free script slots)
+	if (isCreated && CanQueue(count)) {
+
+		shared_ptr<BackgroundScriptGroup> scriptGroup = make_shared<BackgroundScriptGroup>();
+		uint32 groupID = ++lastGroupID;
+
+		// Group ID 0 is reserved for scripts without a group
+		if (groupID == 0) {
+			groupID = ++lastGroupID;
+		}
+
+		for (size_t i = 0; i < group.size(); i++) {
+
+			group[i]->groupID = groupID;
+			group[i]->id = backgroundScripts->Add(group[i]);
+
+			scriptGroup->scripts.push_back(group[i]->id);
+		}
+
+		scriptGroup->total = count;
+		scriptGroup->live = count;
+
+		UpdateQueued(static_cast<int>(count));
+
+		if (count > 0) {
+			scriptGroups[groupID] = scriptGroup;
+		}
+
+		backgroundScriptsMutex.unlock();
+
+		// NOTE: The persistent V8 handles will be released by the worker threads
+		for (uint32 i = 0; i < count; i++) {
+
+			if (function.IsEmpty()) {
+				group[i]->script.Reset(isolate, scripts[i]);
+			}
+			else {
+				group[i]->function.Reset(isolate, function);
+				group[i]->arguments.Reset(isolate, argumentSets->Get(i));
+			}
+
+			spawnPool->Post(std::bind(Extension::Spawn, group[i]), group[i]->priority);
+		}
+
+		Metrics::Get().Add("spawn.groups");
+		Metrics::Get().Add("spawn.groupScripts", count);
+
+		return SQF::String(GetGroupHandle(groupID));
+	}
+
+	backgroundScriptsMutex.unlock();
+
+	// System error
+	if (!isCreated) {
+		return SQF::Nil;
+	}
+
+	Metrics::Get().Add("spawn.rejected", count);
+
+	return SQF::False;
+}
+
+// Get state of the background script running on the current thread (NULL if none)
+BackgroundScript* Extension::GetCurrentScript() {
+	return currentScript;
+}
+
+// Mark background script of the current thread as holding (or releasing) the isolate lock
+void Extension::SetScriptRunning(bool isRunning) {
+
+	if (currentScript == NULL) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(currentScript->stateMutex);
+
+	// Lets the main thread tell if it would have to wait for the lock (e.g. idle hints)
+	// NOTE: Counted as locked by Runtime::TurnTaken() right after the lock is taken
+	if (currentScript->isRunning && !isRunning) {
+		currentScript->runtime->BackgroundLocked(false);
+	}
+
+	currentScript->isRunning = isRunning;
+
+	if (!currentScript->isTerminating) {
+		return;
+	}
+
+	// NOTE: Termination requested while the lock was released is delivered
+	// on re-lock, and a pending one must not leak to the next lock owner
+	if (isRunning) {
+		v8::V8::TerminateExecution(currentScript->runtime->isolate);
+	}
+	else {
+		v8::V8::CancelTerminateExecution(currentScript->runtime->isolate);
+	}
+}
+
+// Terminate a background script, optionally waiting until it is done (returns false for invalid handles or timeout)
+bool Extension::Terminate(uint32 scriptID, int timeout) {
+
+	backgroundScriptsMutex.lock();
+	shared_ptr<BackgroundScript> backgroundScript = backgroundScripts->Get(scriptID);
+	backgroundScriptsMutex.unlock();
+
+	if (!backgroundScript) {
+		return false;
+	}
+
+	Runtime* runtime = backgroundScript->runtime;
+	bool isPreempted = false;
+
+	{
+		std::lock_guard<std::mutex> lock(backgroundScript->stateMutex);
 
-	// Dispose persistent script handle
-	script.Dispose();
-	script.Clear();
+		backgroundScript->isTerminating = true;
+
+		// Wake up sleep()
+		SetEvent(backgroundScript->terminationEvent);
+
+		if (backgroundScript->isRunning) {
+
+			// Without preemption the script thread is the only one holding the isolate lock
+			if (!runtime->IsPreemptive()) {
+				v8::V8::TerminateExecution(runtime->isolate);
+			}
+			else {
+				isPreempted = true;
+			}
+		}
+	}
+
+	// Preempted script is terminated by V8 thread ID when it gets the lock back
+	if (isPreempted) {
+
+		Runtime::MainThreadScope mainThreadScope(runtime);
+
+		v8::Locker locker(runtime->isolate); // Critical section
+		v8::Isolate::Scope isolateScope(runtime->isolate);
+
+		mainThreadScope.Locked();
+
+		std::lock_guard<std::mutex> lock(backgroundScript->stateMutex);
+
+		if (backgroundScript->isRunning) {
+			v8::V8::TerminateExecution(backgroundScript->threadID);
+		}
+	}
+
+	Metrics::Get().Add("spawn.terminated");
+
+	if (timeout <= 0) {
+		return true;
+	}
+
+	// Wait until the script has unwound and its resources are released
+	std::unique_lock<std::mutex> lock(backgroundScriptsMutex);
+
+	return backgroundScriptsCondition.wait_for(lock, std::chrono::milliseconds(timeout), [&]() {
+		return backgroundScripts->Find(scriptID) == NULL;
+	});
+}
+
+// Terminate all scripts of a spawn group, optionally waiting until they are done
+bool Extension::TerminateGroup(uint32 groupID, int timeout) {
+
+	std::vector<uint32> scripts;
+
+	backgroundScriptsMutex.lock();
+
+	auto it = scriptGroups.find(groupID);
+
+	if (it != scriptGroups.end()) {
+		scripts = it->second->scripts;
+	}
+
+	backgroundScriptsMutex.unlock();
+
+	if (scripts.empty()) {
+		return false;
+	}
+
+	// NOTE: Already finished scripts have stale handles and are skipped
+	for (size_t i = 0; i < scripts.size(); i++) {
+		Terminate(scripts[i], 0);
+	}
+
+	if (timeout <= 0) {
+		return true;
+	}
+
+	std::unique_lock<std::mutex> lock(backgroundScriptsMutex);
+
+	return backgroundScriptsCondition.wait_for(lock, std::chrono::milliseconds(timeout), [&]() {
+		return scriptGroups.find(groupID) == scriptGroups.end();
+	});
+}
+
+// Check if new background scripts can be queued (admission control)
+bool Extension::CanQueue(uint32 count) const {
+
+	if (backgroundScripts->Free() < count) {
+		return false;
+	}
+
+	// No queueing when all worker threads are busy
+	if (spawnOverflow == EXTENSION_SPAWN_OVERFLOW_REJECT && backgroundScripts->Count() + count > spawnThreads) {
+		return false;
+	}
+
+	// Bounded queue depth
+	if (spawnMaxQueued > 0 && spawnQueued + count > spawnMaxQueued) {
+		return false;
+	}
+
+	return true;
+}
+
+// Account for queued background scripts (negative count when they start running)
+void Extension::UpdateQueued(int count) {
+
+	spawnQueued += count;
+
+	Metrics &metrics = Metrics::Get();
+	metrics.Set("spawn.queueDepth", spawnQueued);
+	metrics.Max("spawn.queueDepthMax", spawnQueued);
+}
+
+// Check if a script (or all/any script of a group) is done
+bool Extension::IsDone(const char* handle, bool isAny) const {
+
+	uint32 groupID = GetGroupID(handle);
+
+	if (groupID == 0) {
+		return backgroundScripts->Find(ScriptTable::FromHandle(handle)) == NULL;
+	}
+
+	auto it = scriptGroups.find(groupID);
+
+	// Finished groups are released (same as stale/invalid handles)
+	if (it == scriptGroups.end()) {
+		return true;
+	}
+
+	return isAny && it->second->live < it->second->total;
+}
+
+// Wait until a script (or all/any script of a group) is done (returns false on timeout)
+bool Extension::Wait(const char* handle, int timeout, bool isAny) {
+
+	std::unique_lock<std::mutex> lock(backgroundScriptsMutex);
+
+	return backgroundScriptsCondition.wait_for(lock, std::chrono::milliseconds(timeout), [&]() {
+		return IsDone(handle, isAny);
+	});
+}
+
+// SQF spawn group handle for a group ID (e.g. "#G2a")
+std::string Extension::GetGroupHandle(uint32 groupID) {
+
+	char handle[16];
+
+	handle[0] = JS_PROTOCOL_COMMAND;
+	handle[1] = JS_PROTOCOL_TOKEN_SPAWN_GROUP;
+
+	_ultoa(groupID, handle + JS_PROTOCOL_LENGTH, 16);
+
+	return handle;
+}
+
+// Parse SQF spawn group handle (returns 0 for invalid handles)
+uint32 Extension::GetGroupID(const char* handle) {
+
+	if (handle[0] != JS_PROTOCOL_COMMAND || handle[1] != JS_PROTOCOL_TOKEN_SPAWN_GROUP) {
+		return 0;
+	}
+
+	char* end = NULL;
+	unsigned long groupID = strtoul(handle + JS_PROTOCOL_LENGTH, &end, 16);
+
+	if (end == handle + JS_PROTOCOL_LENGTH || *end != '\0') {
+		return 0;
+	}
+
+	return static_cast<uint32>(groupID);
+}
+
+// Get metrics name of a spawn priority class
+const char* Extension::GetPriorityName(int priority) {
+
+	if (priority == JS_PRIORITY_HIGH) {
+		return "high";
+	}
+	else if (priority == JS_PRIORITY_LOW) {
+		return "low";
+	}
+
+	return "normal";
 }
 
 // Get V8 JavaScript exception message
 std::string Extension::GetException(const v8::TryCatch &tryCatch) const {
 
-	v8::HandleScope handleScope(isolate);
+	v8::HandleScope handleScope(v8::Isolate::GetCurrent());
 
 	v8::String::Utf8Value exception(tryCatch.Exception());
 	v8::Handle<v8::Message> message = tryCatch.Message();
@@ -339,22 +1197,53 @@ std::string Extension::GetException(const v8::TryCatch &tryCatch) const {
 	return exceptionMessage;
 }
 
-// Generate script handle for a given thread ID
-std::string Extension::GetScriptHandle(const std::thread::id &threadID) {
+// Get (or create) runtime for a given namespace
+Runtime* Extension::GetRuntime(const std::string &name) {
+
+	std::lock_guard<std::mutex> lock(runtimesMutex);
 
-	std::stringstream ss;
+	auto it = runtimes.find(name);
 
-	// SQF representation of the spawned script handle
-	ss << JS_PROTOCOL_COMMAND << JS_PROTOCOL_TOKEN_SPAWN;
-	ss << threadID;
+	if (it != runtimes.end()) {
+		return it->second.get();
+	}
+
+	// NOTE: Runtimes live until the extension is unloaded (background scripts may still use them)
+	shared_ptr<Runtime> runtime;
+
+	try {
+		runtime = make_shared<Runtime>(name);
+	}
+	catch (...) {
+		return NULL;
+	}
+
+	runtimes[name] = runtime;
 
-	return ss.str();
+	return runtime.get();
 }
 
 // Destructor
 Extension::~Extension() {
 
-	// Release V8 execution context handle
-	context.Dispose();
-	context.Clear();
+	// Stop background script worker threads
+	spawnPool.reset();
+
+	// Stop I/O thread and release unfinished HTTP transfers (while their isolates are still alive)
+	curlEngine->Stop();
+
+	// Stop worker threads and release worker isolates
+	workerPool.reset();
+
+	// Stop execution watchdog thread
+	watchdog.reset();
+
+	// Release namespaced runtimes (and their V8 isolates)
+	runtimes.clear();
+
+	// Release default runtime
+	defaultRuntime.reset();
+
+	// Release multi handle (posted delivery tasks may refer to the engine until event loops are stopped)
+	curlEngine.reset();
 }
\ No newline at end of file
@@ -22,6 +22,17 @@
 #include "Common.h"
 #include "Singleton.h"
 
+#include <condition_variable>
+
+class Runtime;
+class ThreadPool;
+class WorkerPool;
+class CurlEngine;
+class Watchdog;
+class ScriptTable;
+struct BackgroundScript;
+struct BackgroundScriptGroup;
+
 // Real Virtuality extension API exports
 extern "C"
 {
@@ -41,29 +52,114 @@ public:
 
 protected:
 
+	// Run JavaScript code and return the result as SQF output (within a given runtime)
+	std::string Run(Runtime* runtime, const char* input);
+
 	// Run JavaScript code in parallel/background (non-blocking mode)
-	static void Spawn(v8::Persistent<v8::Script> script);
+	static void Spawn(shared_ptr<BackgroundScript> backgroundScript);
+
+	// Run multiple scripts (or one function with multiple argument sets) in the background as a group
+	// NOTE: Must be called while holding the isolate lock (within runtime context)
+	std::string SpawnGroup(Runtime* runtime, const char* payload);
+
+	// Get state of the background script running on the current thread (NULL if none)
+	static BackgroundScript* GetCurrentScript();
+
+	// Mark background script of the current thread as holding (or releasing) the isolate lock
+	// NOTE: Must be called while holding the isolate lock (before Unlocker and after re-locking)
+	static void SetScriptRunning(bool isRunning);
+
+	// Terminate a background script, optionally waiting until it is done (returns false for invalid handles or timeout)
+	bool Terminate(uint32 scriptID, int timeout);
+
+	// Terminate all scripts of a spawn group, optionally waiting until they are done
+	bool TerminateGroup(uint32 groupID, int timeout);
+
+	// Check if new background scripts can be queued (admission control)
+	// NOTE: Must be called while holding the background scripts mutex
+	bool CanQueue(uint32 count) const;
+
+	// Account for queued background scripts (negative count when they start running)
+	// NOTE: Must be called while holding the background scripts mutex
+	void UpdateQueued(int count);
+
+	// Check if a script (or all/any script of a group) is done
+	// NOTE: Must be called while holding the background scripts mutex
+	bool IsDone(const char* handle, bool isAny) const;
+
+	// Wait until a script (or all/any script of a group) is done (returns false on timeout)
+	bool Wait(const char* handle, int timeout, bool isAny);
+
+	// SQF spawn group handle for a group ID and back (0 for invalid handles)
+	static std::string GetGroupHandle(uint32 groupID);
+	static uint32 GetGroupID(const char* handle);
+
+	// Get (or create) runtime for a given namespace
+	Runtime* GetRuntime(const std::string &name);
+
+	// Get metrics name of a spawn priority class
+	static const char* GetPriorityName(int priority);
 
 	// Get V8 JavaScript exception message
 	std::string GetException(const v8::TryCatch &tryCatch) const;
 
-	// Generate script handle for a given thread ID
-	static std::string GetScriptHandle(const std::thread::id &threadID);
-
 private:
 
-	// V8 isolate and execution context
-	v8::Isolate* isolate;
-	v8::Persistent<v8::Context> context;
+	// Default runtime (default V8 isolate)
+	unique_ptr<Runtime> defaultRuntime;
+
+	// Namespaced runtimes (namespace => separate V8 isolate)
+	std::unordered_map<std::string, shared_ptr<Runtime>> runtimes;
+	std::mutex runtimesMutex;
 
 	// Main thread ID
 	std::thread::id mainThreadID;
 
-	// Active background scripts (script handle => termination event)
-	std::unordered_map<std::string, HANDLE> backgroundScripts;
+	// Active background scripts (script ID => script state)
+	unique_ptr<ScriptTable> backgroundScripts;
 	std::mutex backgroundScriptsMutex;
 
+	// Signaled when a background script is done (for blocking JS_fnc_terminate and JS_fnc_wait)
+	std::condition_variable backgroundScriptsCondition;
+
+	// Spawn groups with unfinished scripts (group ID => group state)
+	// NOTE: Guarded by the background scripts mutex
+	std::unordered_map<uint32, shared_ptr<BackgroundScriptGroup>> scriptGroups;
+	uint32 lastGroupID;
+
+	// Background script worker threads
+	unique_ptr<ThreadPool> spawnPool;
+
+	// Lower priority class scripts are promoted after this time (in milliseconds)
+	int spawnAgingTime;
+
+	// Admission control: worker threads, queued script limit (0 for no limit) and overflow policy
+	uint32 spawnThreads;
+	uint32 spawnMaxQueued;
+	int spawnOverflow;
+
+	// Number of queued (not yet running) background scripts and coalescable ones (source key => script ID)
+	// NOTE: Guarded by the background scripts mutex
+	uint32 spawnQueued;
+	std::unordered_map<std::string, uint32> spawnQueuedSources;
+
+	// Worker isolates for parallel.map()
+	unique_ptr<WorkerPool> workerPool;
+
+	// Asynchronous HTTP transfers (curl.performAsync)
+	unique_ptr<CurlEngine> curlEngine;
+
+	// Execution time budget for JS_fnc_exec (in milliseconds, 0 for no limit)
+	int execTimeout;
+	unique_ptr<Watchdog> watchdog;
+
 	// Friends
 	friend class JavaScript;
 	friend class SQF;
+	friend class WorkerPool;
+	friend class Channel;
+	friend class CancellationToken;
+	friend class NativeKernels;
+	friend class LibCurlJSAPI;
+	friend class Runtime;
 };
\ No newline at end of file
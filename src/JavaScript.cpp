@@ -20,6 +20,11 @@
 #include "JavaScript.h"
 #include "Extension.h"
 #include "SQF.h"
+#include "Runtime.h"
+#include "BackgroundScript.h"
+#include "CancellationToken.h"
+#include "Watchdog.h"
+#include "ThreadPool.h"
 
 // Special JavaScript number values
 #define JAVASCRIPT_NAN "NaN"
@@ -98,14 +103,6 @@ std::string JavaScript::ToSQF(const v8::Handle<v8::Value> value) {
 // Global sleep() function
 void JavaScript::Sleep(const v8::FunctionCallbackInfo<v8::Value>& args) {
 
-	// NOTE: IsExecutionTerminating() doesn't seem to work when TerminateExecution()
-	// is invoked by V8 thread ID. We are using a local TLS flag as a workaround.
-	__declspec(thread) static bool terminateExecution = false;
-
-	if (terminateExecution) {
-		return;
-	}
-
 	v8::Isolate* isolate = args.GetIsolate();
 	Extension &extension = Extension::Get();
 
@@ -118,51 +115,159 @@ void JavaScript::Sleep(const v8::FunctionCallbackInfo<v8::Value>& args) {
 		return;
 	}
 
+	// NOTE: Running scripts are terminated by Extension::Terminate(), the per-script
+	// flag makes sleep() return right away while termination is pending.
+	BackgroundScript* backgroundScript = Extension::GetCurrentScript();
+
+	// Event loop callbacks and parallel workers must not block their thread (other callbacks would stall)
+	if (backgroundScript == NULL) {
+
+		v8::HandleScope handleScope(isolate);
+		v8::ThrowException(v8::String::New("sleep() can only be used with a background script (JS_fnc_spawn), use setTimeout() in callbacks"));
+
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(backgroundScript->stateMutex);
+
+		if (backgroundScript->isTerminating) {
+			return;
+		}
+	}
+
 	// Process sleep
 	if (args.Length() && args[0]->IsNumber()) {
 
 		double sleepForValue = max(args[0]->NumberValue(), 0);
 
-		{
-			// Let other threads use V8 during sleep
-			isolate->Exit();
-			v8::Unlocker unlocker(isolate);
+		// Let other threads use V8 during sleep
+		Wait(isolate, NULL, static_cast<DWORD>(sleepForValue * 1000 + 0.5));
+	}
+}
 
-			DWORD sleepFor = static_cast<DWORD>(sleepForValue * 1000 + 0.5);
-			__declspec(thread) static HANDLE terminationEvent = NULL;
+// Global lowMemory() function (returns used heap size in bytes before and after)
+void JavaScript::LowMemory(const v8::FunctionCallbackInfo<v8::Value>& args) {
 
-			// Cache termination event handle locally
-			if (terminationEvent == NULL) {
+	v8::Isolate* isolate = args.GetIsolate();
+	Runtime* runtime = static_cast<Runtime*>(isolate->GetData());
 
-				std::string scriptHandle = Extension::GetScriptHandle(std::this_thread::get_id());
-				
-				extension.backgroundScriptsMutex.lock();
+	size_t usedBefore;
+	size_t usedAfter;
 
-				auto it = extension.backgroundScripts.find(scriptHandle);
+	runtime->Compact(usedBefore, usedAfter);
 
-				if (it != extension.backgroundScripts.end()) {
-					terminationEvent = it->second;
-				}
+	v8::HandleScope handleScope(isolate);
+	v8::Handle<v8::Object> result = v8::Object::New();
 
-				extension.backgroundScriptsMutex.unlock();
-			}
+	result->Set(v8::String::NewFromUtf8(isolate, "before"), v8::Number::New(static_cast<double>(usedBefore)));
+	result->Set(v8::String::NewFromUtf8(isolate, "after"), v8::Number::New(static_cast<double>(usedAfter)));
 
-			if (terminationEvent != NULL) {
+	args.GetReturnValue().Set(result);
+}
 
-				DWORD sleepResult = WaitForSingleObject(terminationEvent, sleepFor);
+// Release the isolate lock and wait for a handle (NULL for none) or cancellation (background script termination or exec time budget)
+DWORD JavaScript::Wait(v8::Isolate* isolate, HANDLE handle, DWORD milliseconds) {
 
-				// Termination event signal
-				if (sleepResult == WAIT_OBJECT_0) {
-					terminateExecution = true;
-				}
-			}
+	BackgroundScript* backgroundScript = Extension::GetCurrentScript();
+
+	// Cancellation event is only available to background scripts and time budgeted execs
+	HANDLE handles[2];
+	DWORD count = 0;
+
+	handles[count++] = CancellationToken::Current().GetEvent();
+
+	if (handle != NULL) {
+		handles[count++] = handle;
+	}
+
+	DWORD result;
+
+	Unlocked(isolate, [&]() {
+
+		if (handles[0] != NULL) {
+			result = WaitForMultipleObjects(count, handles, FALSE, milliseconds);
+		}
+		else if (handle != NULL) {
+			result = (WaitForSingleObject(handle, milliseconds) == WAIT_OBJECT_0) ? WAIT_OBJECT_0 + 1 : WAIT_TIMEOUT;
+		}
+		else {
+			::Sleep(milliseconds);
+			result = WAIT_TIMEOUT;
+		}
+
+		// Termination event signal (time budget is enforced by the watchdog once the lock is taken again)
+		if (result == WAIT_OBJECT_0 && backgroundScript != NULL) {
+
+			std::lock_guard<std::mutex> lock(backgroundScript->stateMutex);
+			backgroundScript->isTerminating = true;
+		}
+	});
+
+	return result;
+}
+
+// Run blocking native work with the isolate lock released
+void JavaScript::Unlocked(v8::Isolate* isolate, std::function<void ()> work) {
+
+	BackgroundScript* backgroundScript = Extension::GetCurrentScript();
+	Runtime* runtime = static_cast<Runtime*>(isolate->GetData());
+
+	Extension &extension = Extension::Get();
+	bool isMainThread = (std::this_thread::get_id() == extension.mainThreadID);
+
+	{
+		Extension::SetScriptRunning(false);
+
+		// Exec time budget running out during the work must not terminate other lock owners
+		extension.watchdog->SetUnlocked(true);
+
+		// Blocked worker thread lets a spare thread run queued scripts (e.g. the producer a recv() waits for)
+		ThreadPool::Blocking(true);
+
+		// Blocked main thread must not hold back background scripts it may be waiting for (e.g. channel senders)
+		if (isMainThread) {
+			runtime->SuspendMainThreadPriority();
 		}
 
-		isolate->Enter();
+		isolate->Exit();
+		v8::Unlocker unlocker(isolate);
+
+		work();
+
+		ThreadPool::Blocking(false);
 
-		// Try to terminate V8 thread/script
-		if (terminateExecution) {
-			v8::V8::TerminateExecution(v8::V8::GetCurrentThreadId());
+		// Main thread exec (and higher priority scripts) have priority over waking background scripts
+		if (backgroundScript != NULL) {
+			runtime->WaitForTurn(backgroundScript->priority, extension.spawnAgingTime);
 		}
+		else if (isMainThread) {
+			runtime->ResumeMainThreadPriority();
+		}
+		else {
+			runtime->WaitForMainThread();
+		}
+	}
+
+	if (backgroundScript != NULL) {
+		runtime->TurnTaken(backgroundScript->priority);
 	}
+
+	isolate->Enter();
+
+	// Stack limit is per thread, but other threads may have changed it
+	runtime->SetStackLimit();
+
+	// Terminates the script if JS_fnc_terminate was called (or the exec time budget ran out) during the work
+	Extension::SetScriptRunning(true);
+	extension.watchdog->SetUnlocked(false);
+}
+
+// Call JSON.stringify/JSON.parse of the current context
+v8::Handle<v8::Value> JavaScript::CallJSON(const char* method, v8::Handle<v8::Value> value) {
+
+	v8::Handle<v8::Object> json = v8::Handle<v8::Object>::Cast(v8::Context::GetCurrent()->Global()->Get(v8::String::NewSymbol("JSON")));
+	v8::Handle<v8::Function> function = v8::Handle<v8::Function>::Cast(json->Get(v8::String::NewSymbol(method)));
+
+	return function->Call(json, 1, &value);
 }
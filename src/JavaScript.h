@@ -21,6 +21,8 @@
 
 #include "Common.h"
 
+#include <functional>
+
 // JavaScript language support component
 class JavaScript {
 
@@ -32,4 +34,18 @@ public:
 	// Global sleep() function
 	static void Sleep(const v8::FunctionCallbackInfo<v8::Value>& args);
 
+	// Global lowMemory() function (returns used heap size in bytes before and after)
+	static void LowMemory(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// Release the isolate lock and wait for a handle (NULL for none) or background script termination
+	// Returns WAIT_OBJECT_0 on termination, WAIT_OBJECT_0 + 1 when the handle is signaled or WAIT_TIMEOUT
+	static DWORD Wait(v8::Isolate* isolate, HANDLE handle, DWORD milliseconds);
+
+	// Run blocking native work with the isolate lock released (work must not touch V8)
+	// NOTE: Main thread exec and higher priority scripts get the lock first when the work is done
+	static void Unlocked(v8::Isolate* isolate, std::function<void ()> work);
+
+	// Call JSON.stringify/JSON.parse of the current context
+	static v8::Handle<v8::Value> CallJSON(const char* method, v8::Handle<v8::Value> value);
+
 };
\ No newline at end of file
@@ -16,6 +16,13 @@
  */
 #include "SilkJS.h"
 #include "LibCurlJSAPI.h"
+#include "Natives.h"
+#include "JavaScript.h"
+#include "CancellationToken.h"
+#include "CurlEngine.h"
+#include "Extension.h"
+#include "Runtime.h"
+#include "Metrics.h"
 #include <curl/curl.h>
 
 struct CHANDLE {
@@ -27,6 +34,7 @@ struct CHANDLE {
     curl_slist *slist;
     curl_httppost *post;
     curl_httppost *last;
+    bool busy;
 };
 
 static inline CHANDLE *XHANDLE (Handle<Value>v) {
@@ -35,6 +43,11 @@ static inline CHANDLE *XHANDLE (Handle<Value>v) {
         return NULL;
     }
     CHANDLE *w = (CHANDLE *) JSOPAQUE(v);
+    // Handle belongs to the I/O thread until its asynchronous transfer is delivered
+    if (w->busy) {
+        ThrowException(String::New("Handle is busy"));
+        return NULL;
+    }
     return w;
 }
 
@@ -68,6 +81,12 @@ static size_t WriteHeaderCallback (void *contents, size_t size, size_t nmemb, vo
     return realsize;
 }
 
+// Abort the transfer when the background script is terminated
+static int ProgressCallback (void *clientp, double dltotal, double dlnow, double ultotal, double ulnow) {
+    CancellationToken *token = (CancellationToken *) clientp;
+    return token->IsCancelled() ? 1 : 0;
+}
+
 void LibCurlJSAPI::Error (const v8::FunctionCallbackInfo<v8::Value>& args) {
     CURLcode eNumber = (CURLcode) args[0]->IntegerValue();
 	args.GetReturnValue().Set(v8::String::New(curl_easy_strerror(eNumber)));
@@ -75,7 +94,7 @@ void LibCurlJSAPI::Error (const v8::FunctionCallbackInfo<v8::Value>& args) {
 
 void LibCurlJSAPI::Initialize (const v8::FunctionCallbackInfo<v8::Value>& args) {
     v8::String::Utf8Value url(args[0]->ToString());
-    CURL *curl = curl_easy_init();
+    CURL *curl = ::Extension::Get().curlEngine->Acquire();
     if (!curl) {
         args.GetReturnValue().Set(v8::String::New("Could not initialize CURL library"));
 		return;
@@ -88,6 +107,7 @@ void LibCurlJSAPI::Initialize (const v8::FunctionCallbackInfo<v8::Value>& args)
     w->hsize = 0;
     w->slist = NULL;
     w->post = NULL;
+    w->busy = false;
     w->last = NULL;
     curl_easy_setopt(curl, CURLOPT_URL, *url);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
@@ -101,6 +121,9 @@ void LibCurlJSAPI::Initialize (const v8::FunctionCallbackInfo<v8::Value>& args)
 
 void LibCurlJSAPI::SetMethod (const v8::FunctionCallbackInfo<v8::Value>& args) {
     CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
     v8::String::Utf8Value method(args[1]->ToString());
 	if (!lstrcmpi((LPCWSTR) *method, (LPCWSTR) "post")) {
         args.GetReturnValue().Set(v8::Integer::New(curl_easy_setopt(h->curl, CURLOPT_POST, 1)));
@@ -115,18 +138,27 @@ void LibCurlJSAPI::SetMethod (const v8::FunctionCallbackInfo<v8::Value>& args) {
 
 void LibCurlJSAPI::FollowRedirects (const v8::FunctionCallbackInfo<v8::Value>& args) {
     CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
     long flag = (long) args[0]->IntegerValue();
 	args.GetReturnValue().Set(v8::Integer::New(curl_easy_setopt(h->curl, CURLOPT_FOLLOWLOCATION, flag)));
 }
 
 void LibCurlJSAPI::SetCookie (const v8::FunctionCallbackInfo<v8::Value>& args) {
     CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
     v8::String::Utf8Value cookie_string(args[1]->ToString());
     args.GetReturnValue().Set(v8::Integer::New(curl_easy_setopt(h->curl, CURLOPT_COOKIE, *cookie_string)));
 }
 
 void LibCurlJSAPI::SetHeader (const v8::FunctionCallbackInfo<v8::Value>& args) {
     CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
     v8::String::Utf8Value header_string(args[1]->ToString());
     h->slist = curl_slist_append(h->slist, *header_string);
     args.GetReturnValue().Set(v8::Undefined());
@@ -134,6 +166,9 @@ void LibCurlJSAPI::SetHeader (const v8::FunctionCallbackInfo<v8::Value>& args) {
 
 void LibCurlJSAPI::AddFormField(const v8::FunctionCallbackInfo<v8::Value>& args) {
     CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
     v8::String::Utf8Value name(args[1]->ToString());
     v8::String::Utf8Value value(args[2]->ToString());
     char *contentType = NULL;
@@ -151,6 +186,9 @@ void LibCurlJSAPI::AddFormField(const v8::FunctionCallbackInfo<v8::Value>& args)
 
 void LibCurlJSAPI::AddFormFile(const v8::FunctionCallbackInfo<v8::Value>& args) {
     CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
     v8::String::Utf8Value name(args[1]->ToString());
     v8::String::Utf8Value filename(args[2]->ToString());
     char *contentType = NULL;
@@ -168,6 +206,9 @@ void LibCurlJSAPI::AddFormFile(const v8::FunctionCallbackInfo<v8::Value>& args)
 
 void LibCurlJSAPI::SetPostFields (const v8::FunctionCallbackInfo<v8::Value>& args) {
     CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
     v8::String::Utf8Value post_fields(args[1]->ToString());
     //    printf("%d %s\n", strlen(*post_fields), *post_fields);
     curl_easy_setopt(h->curl, CURLOPT_POSTFIELDSIZE, strlen(*post_fields));
@@ -176,28 +217,99 @@ void LibCurlJSAPI::SetPostFields (const v8::FunctionCallbackInfo<v8::Value>& arg
 
 void LibCurlJSAPI::SetTimeout (const v8::FunctionCallbackInfo<v8::Value>& args) {
     CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
     long timeout = args[1]->IntegerValue();
     curl_easy_setopt(h->curl, CURLOPT_NOSIGNAL, 1);
     curl_easy_setopt(h->curl, CURLOPT_TIMEOUT, timeout);
     args.GetReturnValue().Set(v8::Undefined());
 }
 
-void LibCurlJSAPI::Perform (const v8::FunctionCallbackInfo<v8::Value>& args) {
-    CHANDLE *h = XHANDLE(args[0]);
+static void PrepareTransfer (CHANDLE *h) {
     if (h->slist) {
         curl_easy_setopt(h->curl, CURLOPT_HTTPHEADER, h->slist);
     }
     if (h->post) {
         curl_easy_setopt(h->curl, CURLOPT_HTTPPOST, h->post);
     }
+}
+
+void LibCurlJSAPI::Perform (const v8::FunctionCallbackInfo<v8::Value>& args) {
+    CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
+    PrepareTransfer(h);
     if (args.Length() > 1) {
         curl_easy_setopt(h->curl, CURLOPT_VERBOSE, args[1]->IntegerValue());
     }
-    args.GetReturnValue().Set(v8::Integer::New(curl_easy_perform(h->curl)));
+    // Terminated background script (or exec past its time budget) aborts the transfer (instead of waiting for a timeout)
+    CancellationToken token = CancellationToken::Current();
+    if (token.IsValid()) {
+        curl_easy_setopt(h->curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(h->curl, CURLOPT_PROGRESSFUNCTION, ProgressCallback);
+        curl_easy_setopt(h->curl, CURLOPT_PROGRESSDATA, (void *) &token);
+    }
+    // Other threads can use the isolate during the transfer, the busy handle is off limits for them
+    CURLcode result;
+    h->busy = true;
+    JavaScript::Unlocked(args.GetIsolate(), [&]() {
+        result = curl_easy_perform(h->curl);
+    });
+    h->busy = false;
+    if (token.IsValid()) {
+        curl_easy_setopt(h->curl, CURLOPT_NOPROGRESS, 1L);
+        curl_easy_setopt(h->curl, CURLOPT_PROGRESSDATA, NULL);
+        if (result == CURLE_ABORTED_BY_CALLBACK) {
+            Metrics::Get().Add("curl.cancelled");
+        }
+    }
+    args.GetReturnValue().Set(v8::Integer::New(result));
+}
+
+void LibCurlJSAPI::PerformAsync (const v8::FunctionCallbackInfo<v8::Value>& args) {
+    CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
+    if (args.Length() < 2 || !args[1]->IsFunction()) {
+        ThrowException(Exception::TypeError(String::New("Callback must be a function")));
+        return;
+    }
+    PrepareTransfer(h);
+    Runtime *runtime = static_cast<Runtime *>(args.GetIsolate()->GetData());
+    if (!::Extension::Get().curlEngine->Perform(runtime, h->curl, &h->busy, Handle<Function>::Cast(args[1]), args[0])) {
+        ThrowException(String::New("CURL engine is stopped"));
+        return;
+    }
+    args.GetReturnValue().Set(v8::Undefined());
+}
+
+void LibCurlJSAPI::Poll (const v8::FunctionCallbackInfo<v8::Value>& args) {
+    Runtime *runtime = static_cast<Runtime *>(args.GetIsolate()->GetData());
+    args.GetReturnValue().Set(v8::Integer::NewFromUnsigned((uint32) ::Extension::Get().curlEngine->Pending(runtime)));
+}
+
+void LibCurlJSAPI::Drain (const v8::FunctionCallbackInfo<v8::Value>& args) {
+    Runtime *runtime = static_cast<Runtime *>(args.GetIsolate()->GetData());
+    args.GetReturnValue().Set(v8::Integer::NewFromUnsigned((uint32) ::Extension::Get().curlEngine->Drain(runtime)));
+}
+
+void LibCurlJSAPI::Shared (const v8::FunctionCallbackInfo<v8::Value>& args) {
+    std::vector<std::string> shared = ::Extension::Get().curlEngine->GetShared();
+    v8::Local<v8::Array> types = v8::Array::New((int) shared.size());
+    for (uint32 i = 0; i < shared.size(); i++) {
+        types->Set(i, v8::String::New(shared[i].c_str()));
+    }
+    args.GetReturnValue().Set(types);
 }
 
 void LibCurlJSAPI::GetResponseCode (const v8::FunctionCallbackInfo<v8::Value>& args) {
     CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
     long status;
     curl_easy_getinfo(h->curl, CURLINFO_RESPONSE_CODE, &status);
     args.GetReturnValue().Set(v8::Integer::New(status));
@@ -205,6 +317,9 @@ void LibCurlJSAPI::GetResponseCode (const v8::FunctionCallbackInfo<v8::Value>& a
 
 void LibCurlJSAPI::GetContentType (const v8::FunctionCallbackInfo<v8::Value>& args) {
     CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
     char *contentType;
     curl_easy_getinfo(h->curl, CURLINFO_CONTENT_TYPE, &contentType);
     if (!contentType) {
@@ -215,6 +330,9 @@ void LibCurlJSAPI::GetContentType (const v8::FunctionCallbackInfo<v8::Value>& ar
 
 void LibCurlJSAPI::GetResponseHeaders (const v8::FunctionCallbackInfo<v8::Value>& args) {
     CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
     if (!h->hsize) {
         args.GetReturnValue().Set(v8::String::New(""));
     } else {
@@ -224,6 +342,9 @@ void LibCurlJSAPI::GetResponseHeaders (const v8::FunctionCallbackInfo<v8::Value>
 
 void LibCurlJSAPI::GetResponseText (const v8::FunctionCallbackInfo<v8::Value>& args) {
     CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
     if (!h->size) {
         args.GetReturnValue().Set(v8::String::New("{}"));
     } else {
@@ -233,6 +354,9 @@ void LibCurlJSAPI::GetResponseText (const v8::FunctionCallbackInfo<v8::Value>& a
 
 void LibCurlJSAPI::Destroy (const v8::FunctionCallbackInfo<v8::Value>& args) {
     CHANDLE *h = XHANDLE(args[0]);
+    if (!h) {
+        return;
+    }
     if (h->slist) {
         curl_slist_free_all(h->slist);
         h->slist = NULL;
@@ -240,15 +364,22 @@ void LibCurlJSAPI::Destroy (const v8::FunctionCallbackInfo<v8::Value>& args) {
     if (h->post) {
         curl_formfree(h->post);
     }
-    curl_easy_cleanup(h->curl);
+    // Connections and the shared cache stay alive for the next curl.init()
+    ::Extension::Get().curlEngine->Release(h->curl);
     free(h->memory);
     free(h->headers);
     free(h);
     args.GetReturnValue().Set(v8::Undefined());
 }
 
-void LibCurlJSAPI::Register (v8::Handle<v8::ObjectTemplate> global) {
+void LibCurlJSAPI::Register () {
+
+	Natives::Get().Register("curl", LibCurlJSAPI::Create);
+}
 
+v8::Handle<v8::Value> LibCurlJSAPI::Create () {
+
+	v8::HandleScope handleScope(v8::Isolate::GetCurrent());
 	v8::PropertyAttribute builtInPropAttr = (v8::PropertyAttribute)(v8::DontDelete | v8::ReadOnly);    
 	v8::Handle<v8::ObjectTemplate> curlObject = v8::ObjectTemplate::New();	
     curlObject->Set(v8::String::NewSymbol("error"), v8::FunctionTemplate::New(LibCurlJSAPI::Error), builtInPropAttr);
@@ -262,12 +393,15 @@ void LibCurlJSAPI::Register (v8::Handle<v8::ObjectTemplate> global) {
     curlObject->Set(v8::String::NewSymbol("setPostFields"), v8::FunctionTemplate::New(LibCurlJSAPI::SetPostFields), builtInPropAttr);
     curlObject->Set(v8::String::NewSymbol("setTimeout"), v8::FunctionTemplate::New(LibCurlJSAPI::SetTimeout), builtInPropAttr);
     curlObject->Set(v8::String::NewSymbol("perform"), v8::FunctionTemplate::New(LibCurlJSAPI::Perform), builtInPropAttr);
+    curlObject->Set(v8::String::NewSymbol("performAsync"), v8::FunctionTemplate::New(LibCurlJSAPI::PerformAsync), builtInPropAttr);
+    curlObject->Set(v8::String::NewSymbol("poll"), v8::FunctionTemplate::New(LibCurlJSAPI::Poll), builtInPropAttr);
+    curlObject->Set(v8::String::NewSymbol("drain"), v8::FunctionTemplate::New(LibCurlJSAPI::Drain), builtInPropAttr);
+    curlObject->Set(v8::String::NewSymbol("shared"), v8::FunctionTemplate::New(LibCurlJSAPI::Shared), builtInPropAttr);
     curlObject->Set(v8::String::NewSymbol("getResponseCode"), v8::FunctionTemplate::New(LibCurlJSAPI::GetResponseCode), builtInPropAttr);
     curlObject->Set(v8::String::NewSymbol("getContentType"), v8::FunctionTemplate::New(LibCurlJSAPI::GetContentType), builtInPropAttr);
     curlObject->Set(v8::String::NewSymbol("getResponseText"), v8::FunctionTemplate::New(LibCurlJSAPI::GetResponseText), builtInPropAttr);
     curlObject->Set(v8::String::NewSymbol("getResponseHeaders"), v8::FunctionTemplate::New(LibCurlJSAPI::GetResponseHeaders), builtInPropAttr);
     curlObject->Set(v8::String::NewSymbol("destroy"), v8::FunctionTemplate::New(LibCurlJSAPI::Destroy), builtInPropAttr);
 		
-    global->Set(v8::String::NewSymbol("curl"), curlObject, builtInPropAttr);
-
+    return handleScope.Close(curlObject->NewInstance());
 }
\ No newline at end of file
@@ -27,7 +27,11 @@ class LibCurlJSAPI {
 
 public:
 
-	static void Register (v8::Handle<v8::ObjectTemplate> global);
+	// Register curl as a lazily installed native module
+	static void Register ();
+
+	// Create curl module object (on first access)
+	static v8::Handle<v8::Value> Create ();
 
 protected:
 
@@ -56,6 +60,8 @@ protected:
 	 * 
 	 * You must call curl.destroy() on the returned handle to free the resources allocated for the CURL request.
 	 * 
+	 * Handles share a process-wide DNS cache (see curl.shared()), and are reused (with their keep-alive connections) after curl.destroy().
+	 * 
 	 * @param {string} url - the URL for the connection.
 	 * @return {object} handle - opaque handle
 	 */
@@ -229,12 +235,73 @@ protected:
 	 * 
 	 * This function is called after the curl.init() and all the method calls to set options are made, and will perform the transfer as described in the options. It must be called with the same handle as input as the curl.init() call returned.
 	 * 
+	 * Terminating the background script (JS_fnc_terminate) aborts the transfer with CURLE_ABORTED_BY_CALLBACK error code.
+	 * 
+	 * The isolate lock is released during the transfer, so other scripts of the same namespace keep running. The handle is busy until the call returns.
+	 * 
 	 * @param {object} handle - CURL handle
 	 * @param {int} verbose - set to > 0 to have cURL library print debugging info to console
 	 * @return {int} status - 0 for success, otherwise an error code.
 	 */
 	static void LibCurlJSAPI::Perform (const v8::FunctionCallbackInfo<v8::Value>& args);
 
+	/**
+	 * @function curl.performAsync
+	 * 
+	 * ### Synopsis
+	 * 
+	 * curl.performAsync(handle, callback);
+	 * 
+	 * Perform the CURL request in the background without blocking the calling script.
+	 * 
+	 * All asynchronous transfers share a single I/O thread (cURL multi interface). Once the transfer is done, callback(status, handle) is called on the event loop thread of the same namespace (like setTimeout() callbacks), or earlier from curl.drain().
+	 * 
+	 * The handle is busy until its callback is called; any other curl function called with a busy handle throws an exception.
+	 * 
+	 * @param {object} handle - CURL handle
+	 * @param {function} callback - function(status, handle) called when the transfer is done (status is 0 for success, otherwise an error code)
+	 */
+	static void LibCurlJSAPI::PerformAsync (const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	/**
+	 * @function curl.poll
+	 * 
+	 * ### Synopsis
+	 * 
+	 * var count = curl.poll();
+	 * 
+	 * Get the number of asynchronous transfers started in this namespace whose callbacks have not been called yet.
+	 * 
+	 * @return {int} count - number of running or undelivered transfers
+	 */
+	static void LibCurlJSAPI::Poll (const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	/**
+	 * @function curl.drain
+	 * 
+	 * ### Synopsis
+	 * 
+	 * var count = curl.drain();
+	 * 
+	 * Call callbacks of asynchronous transfers that are already done right away (instead of waiting for the event loop).
+	 * 
+	 * @return {int} count - number of called callbacks
+	 */
+	static void LibCurlJSAPI::Drain (const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	/**
+	 * @function curl.shared
+	 * 
+	 * ### Synopsis
+	 * 
+	 * var types = curl.shared();
+	 * 
+	 * Get the data types shared between all curl handles of all namespaces. Only "dns" is shared by default, "cookies" are shared if ShareCookies=1 is set in JavaScript.ini and "sslSessions" only with libcurl builds that support it.
+	 * 
+	 * @return {array} types - shared data type names (e.g. ["dns", "cookies"])
+	 */
+	static void LibCurlJSAPI::Shared (const v8::FunctionCallbackInfo<v8::Value>& args);
+
 	/**
 	 * @function curl.getResponseCode
 	 * 
@@ -300,6 +367,8 @@ protected:
 	 * 
 	 * Frees memory allocated by curl.init(), including the handle.  The handle will no longer be valid.
 	 * 
+	 * The underlying cURL handle is reset and kept for reuse by a later curl.init() (see [Curl] HandlePool setting).
+	 * 
 	 * @param {object} handle - CURL handle
 	 */
 	static void LibCurlJSAPI::Destroy (const v8::FunctionCallbackInfo<v8::Value>& args);
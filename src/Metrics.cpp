@@ -0,0 +1,127 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Metrics.h"
+#include "SQF.h"
+
+// Constructor
+Metrics::Metrics() {
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	ticksPerMicrosecond = frequency.QuadPart / 1000000.0;
+}
+
+// Add value to a named counter
+void Metrics::Add(const std::string &name, double value) {
+
+	std::lock_guard<std::mutex> lock(countersMutex);
+
+	counters[name] += value;
+}
+
+// Set named counter value
+void Metrics::Set(const std::string &name, double value) {
+
+	std::lock_guard<std::mutex> lock(countersMutex);
+
+	counters[name] = value;
+}
+
+// Update named counter with a new maximum value
+void Metrics::Max(const std::string &name, double value) {
+
+	std::lock_guard<std::mutex> lock(countersMutex);
+
+	auto it = counters.find(name);
+
+	if (it == counters.end() || it->second < value) {
+		counters[name] = value;
+	}
+}
+
+// Get named counter value
+double Metrics::Value(const std::string &name) {
+
+	std::lock_guard<std::mutex> lock(countersMutex);
+
+	auto it = counters.find(name);
+
+	if (it == counters.end()) {
+		return 0;
+	}
+
+	return it->second;
+}
+
+// Serialize all counters as SQF array of [name, value] pairs
+std::string Metrics::ToSQF() {
+
+	std::lock_guard<std::mutex> lock(countersMutex);
+
+	std::stringstream ss;
+	bool isFirst = true;
+
+	ss.precision(10);
+	ss << "[";
+
+	for (auto it = counters.begin(); it != counters.end(); ++it) {
+
+		if (!isFirst) {
+			ss << ",";
+		}
+
+		ss << "[" << SQF::String(it->first) << "," << it->second << "]";
+
+		isFirst = false;
+	}
+
+	ss << "]";
+
+	return ss.str();
+}
+
+// High resolution timestamp (in microseconds)
+double Metrics::Now() {
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	return counter.QuadPart / Metrics::Get().ticksPerMicrosecond;
+}
+
+// CPU time (kernel and user) used by a thread (in microseconds)
+double Metrics::ThreadTime(HANDLE thread) {
+
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+
+	if (!GetThreadTimes(thread, &creationTime, &exitTime, &kernelTime, &userTime)) {
+		return 0;
+	}
+
+	ULARGE_INTEGER kernel, user;
+	kernel.LowPart = kernelTime.dwLowDateTime;
+	kernel.HighPart = kernelTime.dwHighDateTime;
+	user.LowPart = userTime.dwLowDateTime;
+	user.HighPart = userTime.dwHighDateTime;
+
+	// FILETIME is in 100 nanosecond units
+	return (kernel.QuadPart + user.QuadPart) / 10.0;
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+#include "Singleton.h"
+
+#include <map>
+
+// Runtime metrics (named counters) for monitoring
+class Metrics: public Singleton<Metrics> {
+
+public:
+
+	Metrics();
+
+	// Add value to a named counter
+	void Add(const std::string &name, double value = 1);
+
+	// Set named counter value
+	void Set(const std::string &name, double value);
+
+	// Update named counter with a new maximum value
+	void Max(const std::string &name, double value);
+
+	// Get named counter value
+	double Value(const std::string &name);
+
+	// Serialize all counters as SQF array of [name, value] pairs
+	std::string ToSQF();
+
+	// High resolution timestamp (in microseconds)
+	static double Now();
+
+	// CPU time (kernel and user) used by a thread (in microseconds)
+	static double ThreadTime(HANDLE thread);
+
+private:
+
+	// Named counters (sorted by name)
+	std::map<std::string, double> counters;
+	std::mutex countersMutex;
+
+	// Performance counter ticks per microsecond
+	double ticksPerMicrosecond;
+};
\ No newline at end of file
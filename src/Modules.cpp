@@ -0,0 +1,517 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Modules.h"
+#include "Runtime.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <fstream>
+
+// Default module file extension
+#define MODULES_EXTENSION ".js"
+
+// Module code is wrapped in a function to give it a private scope
+#define MODULES_WRAPPER_BEGIN "(function (exports, require, module, __filename, __dirname) {"
+#define MODULES_WRAPPER_END "\n})"
+
+// Delay before reloading changed files (editors tend to save in several writes)
+#define MODULES_RELOAD_DELAY 100
+
+// Constructor
+Modules::Modules(v8::Isolate* isolate, v8::Persistent<v8::Context> &context):
+	isolate(isolate), context(context), lastCacheID(0) {
+
+	stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+// Install global require() function
+void Modules::Register(v8::Handle<v8::ObjectTemplate> global) {
+
+	v8::PropertyAttribute builtInPropAttr = (v8::PropertyAttribute)(v8::DontDelete | v8::ReadOnly);
+
+	// NOTE: There is no context yet, so the template data must not need one (no arrays or strings)
+	global->Set(v8::String::NewSymbol("require"), v8::FunctionTemplate::New(Modules::Require, v8::External::New(this)), builtInPropAttr);
+}
+
+// Give a sandbox context its own module cache
+uint32 Modules::Open(v8::Handle<v8::Context> context) {
+
+	uint32 cacheID = ++lastCacheID;
+
+	caches[cacheID];
+	context->SetEmbedderData(MODULES_CACHE_DATA_INDEX, v8::Integer::NewFromUnsigned(cacheID));
+
+	return cacheID;
+}
+
+// Release module cache of a sandbox context
+void Modules::Close(uint32 cacheID) {
+
+	auto it = caches.find(cacheID);
+
+	if (it == caches.end()) {
+		return;
+	}
+
+	Dispose(it->second);
+	caches.erase(it);
+}
+
+// Get module cache of a context
+Modules::Cache &Modules::GetCache(v8::Handle<v8::Context> current) {
+
+	// NOTE: Embedder data is only read from sandbox contexts (it is not bounds checked)
+	if (current != v8::Local<v8::Context>::New(isolate, context)) {
+
+		auto it = caches.find(current->GetEmbedderData(MODULES_CACHE_DATA_INDEX)->Uint32Value());
+
+		if (it != caches.end()) {
+			return it->second;
+		}
+	}
+
+	return caches[0];
+}
+
+// Global require(name) function (resolves module paths relative to ARMA working directory)
+void Modules::Require(const v8::FunctionCallbackInfo<v8::Value>& args) {
+
+	Modules* modules = static_cast<Modules*>(v8::Handle<v8::External>::Cast(args.Data())->Value());
+
+	modules->RequireModule(args, "", args.Length() ? args[0] : v8::Handle<v8::Value>());
+}
+
+// Module require(directory, name) function (bound to the module directory)
+void Modules::RequireFrom(const v8::FunctionCallbackInfo<v8::Value>& args) {
+
+	Modules* modules = static_cast<Modules*>(v8::Handle<v8::External>::Cast(args.Data())->Value());
+	v8::String::Utf8Value directory(args[0]);
+
+	modules->RequireModule(args, *directory, args.Length() > 1 ? args[1] : v8::Handle<v8::Value>());
+}
+
+// Load (or get cached) module relative to a base directory
+void Modules::RequireModule(const v8::FunctionCallbackInfo<v8::Value>& args, const std::string &directory, v8::Handle<v8::Value> nameValue) {
+
+	v8::HandleScope handleScope(isolate);
+
+	if (nameValue.IsEmpty() || !nameValue->IsString()) {
+		v8::ThrowException(v8::Exception::TypeError(v8::String::New("require() expects a module path string")));
+		return;
+	}
+
+	v8::String::Utf8Value name(nameValue);
+
+	std::string path = Resolve(directory, *name);
+
+	// Module paths are case insensitive on Windows
+	std::string key(path);
+	std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+
+	// Sandbox contexts have their own module cache
+	Cache &modules = GetCache(isolate->GetCurrentContext());
+
+	auto it = modules.find(key);
+
+	// Already loaded (or currently loading in case of circular dependency)
+	if (it != modules.end()) {
+		args.GetReturnValue().Set(v8::Local<v8::Value>::New(isolate, it->second->exports));
+		return;
+	}
+
+	shared_ptr<Module> module = make_shared<Module>();
+	module->path = path;
+	module->directory = path.substr(0, path.find_last_of('\\') + 1);
+
+	if (!GetLastWriteTime(path, module->lastWriteTime)) {
+
+		std::string message("Cannot find module: ");
+		message += *name;
+
+		v8::ThrowException(v8::Exception::Error(v8::String::New(message.c_str())));
+		return;
+	}
+
+	// Register module early to support circular dependencies
+	v8::Handle<v8::Object> exports = v8::Object::New();
+	module->exports.Reset(isolate, exports);
+	modules[key] = module;
+
+	v8::Handle<v8::Value> result = Load(*module, exports);
+
+	// Module code has thrown an exception (let it propagate to the caller)
+	if (result.IsEmpty()) {
+
+		module->exports.Dispose();
+		module->exports.Clear();
+		modules.erase(key);
+
+		return;
+	}
+
+	// Module has replaced module.exports
+	if (result != exports) {
+		module->exports.Reset(isolate, result);
+	}
+
+	Watch(module->directory);
+
+	args.GetReturnValue().Set(result);
+}
+
+// Create require() function bound to a base directory
+v8::Handle<v8::Function> Modules::NewRequire(const std::string &directory) {
+
+	v8::HandleScope handleScope(isolate);
+
+	if (requireFromTemplate.IsEmpty()) {
+		requireFromTemplate.Reset(isolate, v8::FunctionTemplate::New(Modules::RequireFrom, v8::External::New(this)));
+	}
+
+	// require(name) is require(directory, name) with the directory bound
+	v8::Handle<v8::Function> requireFrom = v8::Local<v8::FunctionTemplate>::New(isolate, requireFromTemplate)->GetFunction();
+	v8::Handle<v8::Function> bind = v8::Handle<v8::Function>::Cast(requireFrom->Get(v8::String::NewSymbol("bind")));
+
+	v8::Handle<v8::Value> argv[] = {
+		v8::Null(),
+		v8::String::New(directory.c_str())
+	};
+
+	return handleScope.Close(v8::Handle<v8::Function>::Cast(bind->Call(requireFrom, 2, argv)));
+}
+
+// Resolve module file path relative to a base directory
+std::string Modules::Resolve(const std::string &directory, const std::string &name) {
+
+	std::string path(name);
+
+	// Use Windows path separators
+	std::replace(path.begin(), path.end(), '/', '\\');
+
+	// Relative module paths (from within another module)
+	if (!directory.empty() && (path.compare(0, 2, ".\\") == 0 || path.compare(0, 3, "..\\") == 0)) {
+		path = directory + path;
+	}
+
+	// Add default file extension
+	size_t dotPos = path.find_last_of('.');
+	size_t slashPos = path.find_last_of('\\');
+
+	if (dotPos == std::string::npos || (slashPos != std::string::npos && dotPos < slashPos)) {
+		path += MODULES_EXTENSION;
+	}
+
+	// Normalize to full path
+	char fullPath[MAX_PATH];
+	DWORD fullPathLength = GetFullPathNameA(path.c_str(), MAX_PATH, fullPath, NULL);
+
+	if (fullPathLength > 0 && fullPathLength < MAX_PATH) {
+		path.assign(fullPath, fullPathLength);
+	}
+
+	return path;
+}
+
+// Compile and run module code, returning module.exports (empty handle on exception)
+v8::Handle<v8::Value> Modules::Load(Module &module, v8::Handle<v8::Value> exports) {
+
+	v8::HandleScope handleScope(isolate);
+
+	std::ifstream file(module.path.c_str(), std::ios::in | std::ios::binary);
+
+	if (!file) {
+
+		std::string message("Cannot read module: ");
+		message += module.path;
+
+		v8::ThrowException(v8::Exception::Error(v8::String::New(message.c_str())));
+		return v8::Handle<v8::Value>();
+	}
+
+	std::string code(MODULES_WRAPPER_BEGIN);
+	code.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	code += MODULES_WRAPPER_END;
+
+	v8::Handle<v8::String> source = v8::String::NewFromUtf8(isolate, code.c_str(), v8::String::kNormalString, (int)code.size());
+	v8::Handle<v8::String> fileName = v8::String::New(module.path.c_str());
+
+	v8::Handle<v8::Script> script = v8::Script::Compile(source, fileName);
+
+	if (script.IsEmpty()) {
+		return v8::Handle<v8::Value>();
+	}
+
+	v8::Handle<v8::Value> wrapper = script->Run();
+
+	if (wrapper.IsEmpty() || !wrapper->IsFunction()) {
+		return v8::Handle<v8::Value>();
+	}
+
+	// module object with the initial exports
+	v8::Handle<v8::Object> moduleObject = v8::Object::New();
+	v8::Handle<v8::String> exportsSymbol = v8::String::NewSymbol("exports");
+
+	moduleObject->Set(exportsSymbol, exports);
+	moduleObject->Set(v8::String::NewSymbol("id"), fileName);
+
+	v8::Handle<v8::Value> argv[] = {
+		exports,
+		NewRequire(module.directory),
+		moduleObject,
+		fileName,
+		v8::String::New(module.directory.c_str())
+	};
+
+	v8::Handle<v8::Value> result = v8::Handle<v8::Function>::Cast(wrapper)->Call(v8::Context::GetCurrent()->Global(), 5, argv);
+
+	if (result.IsEmpty()) {
+		return v8::Handle<v8::Value>();
+	}
+
+	return handleScope.Close(moduleObject->Get(exportsSymbol));
+}
+
+// Swap new module exports into the live exports object
+void Modules::Swap(v8::Handle<v8::Object> live, v8::Handle<v8::Object> fresh) {
+
+	// Remove stale exports
+	v8::Handle<v8::Array> liveNames = live->GetOwnPropertyNames();
+	uint_fast32 liveNamesLength = liveNames->Length();
+
+	for (uint_fast32 i = 0; i < liveNamesLength; i++) {
+		live->Delete(liveNames->Get(i));
+	}
+
+	// Copy new exports
+	v8::Handle<v8::Array> freshNames = fresh->GetOwnPropertyNames();
+	uint_fast32 freshNamesLength = freshNames->Length();
+
+	for (uint_fast32 i = 0; i < freshNamesLength; i++) {
+
+		v8::Handle<v8::Value> name = freshNames->Get(i);
+
+		live->Set(name, fresh->Get(name));
+	}
+}
+
+// Get last modification time of a file
+bool Modules::GetLastWriteTime(const std::string &path, FILETIME &lastWriteTime) {
+
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes)) {
+		return false;
+	}
+
+	lastWriteTime = attributes.ftLastWriteTime;
+
+	return true;
+}
+
+// Start watching module directory for file changes
+void Modules::Watch(const std::string &directory) {
+
+	std::lock_guard<std::mutex> lock(directoriesMutex);
+
+	if (std::find(directories.begin(), directories.end(), directory) != directories.end()) {
+		return;
+	}
+
+	// NOTE: The stop and wake-up events take two of the available wait slots
+	if (directories.size() >= MAXIMUM_WAIT_OBJECTS - 2) {
+		return;
+	}
+
+	directories.push_back(directory);
+
+	// Lazy start of the watcher thread on first loaded module
+	if (!watcherThread.joinable()) {
+		watcherThread = std::thread(&Modules::Watcher, this);
+	}
+	else {
+		SetEvent(wakeEvent);
+	}
+}
+
+// File change watcher thread
+void Modules::Watcher() {
+
+	std::vector<HANDLE> handles;
+	std::vector<std::string> watched;
+	size_t added = 0;
+
+	handles.push_back(stopEvent);
+	handles.push_back(wakeEvent);
+
+	while (true) {
+
+		// Pick up newly added module directories
+		directoriesMutex.lock();
+
+		for (; added < directories.size(); added++) {
+
+			HANDLE notification = FindFirstChangeNotificationA(directories[added].c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+
+			// Directory cannot be watched (its modules are not reloaded, but others still are)
+			if (notification == INVALID_HANDLE_VALUE) {
+
+				Metrics::Get().Add("modules.watchFailed");
+				continue;
+			}
+
+			handles.push_back(notification);
+			watched.push_back(directories[added]);
+
+			Metrics::Get().Add("modules.watched");
+		}
+
+		directoriesMutex.unlock();
+
+		DWORD waitResult = WaitForMultipleObjects((DWORD)handles.size(), handles.data(), FALSE, INFINITE);
+
+		// Stop event (or wait error)
+		if (waitResult == WAIT_OBJECT_0 || waitResult == WAIT_FAILED) {
+			break;
+		}
+
+		size_t index = waitResult - WAIT_OBJECT_0;
+
+		// Directory change notification
+		if (index >= 2 && index < handles.size()) {
+
+			FindNextChangeNotification(handles[index]);
+
+			// Give the writer some time to finish (or stop the watcher)
+			if (WaitForSingleObject(stopEvent, MODULES_RELOAD_DELAY) == WAIT_OBJECT_0) {
+				break;
+			}
+
+			Reload(watched[index - 2]);
+		}
+	}
+
+	for (size_t i = 2; i < handles.size(); i++) {
+		FindCloseChangeNotification(handles[i]);
+	}
+}
+
+// Reload changed modules from a given directory
+void Modules::Reload(const std::string &directory) {
+
+	static_cast<Runtime*>(isolate->GetData())->WaitForMainThread();
+
+	v8::Locker locker(isolate); // Critical section
+	v8::Isolate::Scope isolateScope(isolate);
+	v8::HandleScope handleScope(isolate);
+	v8::Context::Scope contextScope(v8::Local<v8::Context>::New(isolate, context));
+
+	// NOTE: Sandbox module caches only live for a single exec (only the main context modules are reloaded)
+	Cache &modules = caches[0];
+
+	// Reloaded module code can require new modules (and change the cache while it is iterated)
+	std::vector<shared_ptr<Module>> candidates;
+
+	for (auto it = modules.begin(); it != modules.end(); ++it) {
+
+		if (it->second->directory == directory) {
+			candidates.push_back(it->second);
+		}
+	}
+
+	for (auto it = candidates.begin(); it != candidates.end(); ++it) {
+
+		Module &module = **it;
+		FILETIME lastWriteTime;
+
+		// Module file is gone (keep the last loaded version)
+		if (!GetLastWriteTime(module.path, lastWriteTime)) {
+			continue;
+		}
+
+		if (CompareFileTime(&lastWriteTime, &module.lastWriteTime) == 0) {
+			continue;
+		}
+
+		v8::TryCatch tryCatch;
+
+		// Only the changed module is recompiled (with a fresh exports object)
+		v8::Handle<v8::Value> result = Load(module, v8::Object::New());
+
+		// Keep the previous exports if the new module code fails
+		if (result.IsEmpty() || tryCatch.HasCaught()) {
+			continue;
+		}
+
+		module.lastWriteTime = lastWriteTime;
+
+		v8::Handle<v8::Value> live = v8::Local<v8::Value>::New(isolate, module.exports);
+
+		// Existing references to the exports object will see the new code
+		// NOTE: Function exports cannot be swapped in place (only new require() calls will see them)
+		if (live->IsObject() && !live->IsFunction() && result->IsObject() && !result->IsFunction()) {
+			Swap(v8::Handle<v8::Object>::Cast(live), v8::Handle<v8::Object>::Cast(result));
+		}
+		else {
+			module.exports.Reset(isolate, result);
+		}
+
+		Metrics::Get().Add("modules.reloaded");
+	}
+}
+
+// Stop watching module files for changes
+void Modules::Stop() {
+
+	if (watcherThread.joinable()) {
+
+		SetEvent(stopEvent);
+		watcherThread.join();
+	}
+}
+
+// Dispose module exports of a cache
+void Modules::Dispose(Cache &cache) {
+
+	for (auto it = cache.begin(); it != cache.end(); ++it) {
+
+		it->second->exports.Dispose();
+		it->second->exports.Clear();
+	}
+
+	cache.clear();
+}
+
+// Destructor
+Modules::~Modules() {
+
+	Stop();
+
+	// Release live module exports
+	for (auto it = caches.begin(); it != caches.end(); ++it) {
+		Dispose(it->second);
+	}
+
+	requireFromTemplate.Dispose();
+	requireFromTemplate.Clear();
+
+	CloseHandle(stopEvent);
+	CloseHandle(wakeEvent);
+}
\ No newline at end of file
@@ -0,0 +1,131 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+
+#include <vector>
+
+// Context embedder data index of the module cache ID (index 0 is used by the debugger)
+#define MODULES_CACHE_DATA_INDEX 1
+
+// JavaScript module loader (global require() function) with hot reload support
+class Modules {
+
+public:
+
+	Modules(v8::Isolate* isolate, v8::Persistent<v8::Context> &context);
+	~Modules();
+
+	// Install global require() function
+	void Register(v8::Handle<v8::ObjectTemplate> global);
+
+	// Give a sandbox context its own module cache (returns cache ID)
+	// NOTE: Must be called while holding the isolate lock
+	uint32 Open(v8::Handle<v8::Context> context);
+
+	// Release module cache of a sandbox context (modules are loaded again on the next require)
+	// NOTE: Must be called while holding the isolate lock
+	void Close(uint32 cacheID);
+
+	// Stop watching module files for changes
+	void Stop();
+
+protected:
+
+	// Loaded module file
+	struct Module {
+
+		// Full (normalized) file path and parent directory
+		std::string path;
+		std::string directory;
+
+		// File modification time of the currently loaded module code
+		FILETIME lastWriteTime;
+
+		// Live module.exports object (updated in place on reload)
+		v8::Persistent<v8::Value> exports;
+	};
+
+	// Loaded modules of a context (lowercase file path => module)
+	typedef std::unordered_map<std::string, shared_ptr<Module>> Cache;
+
+	// Global require(name) function
+	static void Require(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// Module require(directory, name) function (bound to the module directory)
+	static void RequireFrom(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// Load (or get cached) module relative to a base directory
+	void RequireModule(const v8::FunctionCallbackInfo<v8::Value>& args, const std::string &directory, v8::Handle<v8::Value> name);
+
+	// Create require() function bound to a base directory
+	v8::Handle<v8::Function> NewRequire(const std::string &directory);
+
+	// Get module cache of a context
+	Cache &GetCache(v8::Handle<v8::Context> context);
+
+	// Dispose module exports of a cache
+	static void Dispose(Cache &cache);
+
+	// Resolve module file path relative to a base directory
+	static std::string Resolve(const std::string &directory, const std::string &name);
+
+	// Compile and run module code, returning module.exports (empty handle on exception)
+	v8::Handle<v8::Value> Load(Module &module, v8::Handle<v8::Value> exports);
+
+	// Swap new module exports into the live exports object
+	static void Swap(v8::Handle<v8::Object> live, v8::Handle<v8::Object> fresh);
+
+	// Get last modification time of a file
+	static bool GetLastWriteTime(const std::string &path, FILETIME &lastWriteTime);
+
+	// Start watching module directory for file changes
+	void Watch(const std::string &directory);
+
+	// File change watcher thread
+	void Watcher();
+
+	// Reload changed modules from a given directory
+	void Reload(const std::string &directory);
+
+private:
+
+	// V8 isolate and execution context the modules are loaded into
+	v8::Isolate* isolate;
+	v8::Persistent<v8::Context> &context;
+
+	// Module caches (cache ID => loaded modules), main context uses cache 0
+	// NOTE: Only accessed while holding the isolate lock
+	std::unordered_map<uint32, Cache> caches;
+	uint32 lastCacheID;
+
+	// Template of module require functions (one per isolate, templates are never collected)
+	v8::Persistent<v8::FunctionTemplate> requireFromTemplate;
+
+	// Watched module directories
+	std::vector<std::string> directories;
+	std::mutex directoriesMutex;
+
+	// Watcher thread and its stop/wake-up events
+	std::thread watcherThread;
+	HANDLE stopEvent;
+	HANDLE wakeEvent;
+};
\ No newline at end of file
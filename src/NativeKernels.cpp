@@ -0,0 +1,451 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NativeKernels.h"
+#include "Extension.h"
+#include "JavaScript.h"
+#include "WorkerPool.h"
+#include "Natives.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <limits>
+
+// Arrays shorter than this are processed while holding the isolate lock
+#define NATIVE_KERNELS_UNLOCK_LENGTH 16384
+
+// Minimal number of elements per worker thread chunk
+#define NATIVE_KERNELS_CHUNK_LENGTH 32768
+
+// Maximum number of histogram bins (every worker thread chunk counts into its own bins)
+#define NATIVE_KERNELS_MAX_BINS 65536
+
+// Element ordering with NaN last (std::sort needs strict weak ordering)
+static inline bool Less(double a, double b) {
+	return a < b || (a == a && b != b);
+}
+
+static inline bool Less(int32 a, int32 b) {
+	return a < b;
+}
+
+// Sort chunks in parallel and merge them pairwise
+template <typename Iterator, typename Compare>
+static void ParallelSort(WorkerPool &pool, Iterator begin, const std::vector<size_t> &bounds, Compare less) {
+
+	size_t chunks = bounds.size() - 1;
+
+	pool.ParallelFor(chunks, [&](size_t chunk) {
+		std::sort(begin + bounds[chunk], begin + bounds[chunk + 1], less);
+	});
+
+	for (size_t width = 1; width < chunks; width *= 2) {
+
+		pool.ParallelFor((chunks + width * 2 - 1) / (width * 2), [&](size_t pair) {
+
+			size_t first = pair * width * 2;
+			size_t middle = min(first + width, chunks);
+			size_t last = min(first + width * 2, chunks);
+
+			if (middle < last) {
+				std::inplace_merge(begin + bounds[first], begin + bounds[middle], begin + bounds[last], less);
+			}
+		});
+	}
+}
+
+// Reduce elements in parallel (partial results of each chunk are combined)
+template <typename T>
+static double ParallelReduce(WorkerPool &pool, const T* data, const std::vector<size_t> &bounds, bool isMin, bool isMax) {
+
+	size_t chunks = bounds.size() - 1;
+	std::vector<double> partials(chunks);
+
+	pool.ParallelFor(chunks, [&](size_t chunk) {
+
+		const T* elements = data + bounds[chunk];
+		size_t length = bounds[chunk + 1] - bounds[chunk];
+
+		if (isMin || isMax) {
+
+			double result = isMin ? std::numeric_limits<double>::infinity() : -std::numeric_limits<double>::infinity();
+
+			for (size_t i = 0; i < length; i++) {
+
+				double value = static_cast<double>(elements[i]);
+
+				if (isMin ? value < result : value > result) {
+					result = value;
+				}
+			}
+
+			partials[chunk] = result;
+		}
+		else {
+
+			// Independent accumulators (lets the compiler vectorize and pipeline the loop)
+			double sums[4] = { 0, 0, 0, 0 };
+			size_t i = 0;
+
+			for (; i + 4 <= length; i += 4) {
+				sums[0] += elements[i];
+				sums[1] += elements[i + 1];
+				sums[2] += elements[i + 2];
+				sums[3] += elements[i + 3];
+			}
+
+			for (; i < length; i++) {
+				sums[0] += elements[i];
+			}
+
+			partials[chunk] = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+		}
+	});
+
+	double result = partials[0];
+
+	for (size_t chunk = 1; chunk < chunks; chunk++) {
+
+		if (isMin) {
+			result = min(result, partials[chunk]);
+		}
+		else if (isMax) {
+			result = max(result, partials[chunk]);
+		}
+		else {
+			result += partials[chunk];
+		}
+	}
+
+	return result;
+}
+
+// Count elements per bin in parallel (each chunk has its own counts)
+template <typename T>
+static void ParallelHistogram(WorkerPool &pool, const T* data, const std::vector<size_t> &bounds, double minValue, double maxValue, std::vector<uint32> &counts) {
+
+	size_t chunks = bounds.size() - 1;
+	size_t bins = counts.size();
+	double scale = (maxValue > minValue) ? bins / (maxValue - minValue) : 0;
+
+	std::vector<std::vector<uint32>> partials(chunks, std::vector<uint32>(bins, 0));
+
+	pool.ParallelFor(chunks, [&](size_t chunk) {
+
+		std::vector<uint32> &partial = partials[chunk];
+
+		for (size_t i = bounds[chunk]; i < bounds[chunk + 1]; i++) {
+
+			double value = static_cast<double>(data[i]);
+
+			// NaN fails both comparisons
+			if (!(value >= minValue && value <= maxValue)) {
+				continue;
+			}
+
+			size_t bin = static_cast<size_t>((value - minValue) * scale);
+			partial[min(bin, bins - 1)]++;
+		}
+	});
+
+	for (size_t chunk = 0; chunk < chunks; chunk++) {
+
+		for (size_t bin = 0; bin < bins; bin++) {
+			counts[bin] += partials[chunk][bin];
+		}
+	}
+}
+
+// Register native as a lazily installed native module
+void NativeKernels::Register() {
+	Natives::Get().Register("native", NativeKernels::Create);
+}
+
+// Create native module object (on first access)
+v8::Handle<v8::Value> NativeKernels::Create() {
+
+	v8::HandleScope handleScope(v8::Isolate::GetCurrent());
+	v8::PropertyAttribute attributes = static_cast<v8::PropertyAttribute>(v8::DontDelete | v8::ReadOnly);
+
+	v8::Handle<v8::ObjectTemplate> native = v8::ObjectTemplate::New();
+	native->Set(v8::String::NewSymbol("sort"), v8::FunctionTemplate::New(NativeKernels::Sort), attributes);
+	native->Set(v8::String::NewSymbol("argsort"), v8::FunctionTemplate::New(NativeKernels::Argsort), attributes);
+	native->Set(v8::String::NewSymbol("reduce"), v8::FunctionTemplate::New(NativeKernels::Reduce), attributes);
+	native->Set(v8::String::NewSymbol("histogram"), v8::FunctionTemplate::New(NativeKernels::Histogram), attributes);
+
+	return handleScope.Close(native->NewInstance());
+}
+
+// native.sort(array)
+void NativeKernels::Sort(const v8::FunctionCallbackInfo<v8::Value>& args) {
+
+	v8::Isolate* isolate = args.GetIsolate();
+	v8::HandleScope handleScope(isolate);
+
+	if (args.Length() < 1 || !(args[0]->IsFloat64Array() || args[0]->IsInt32Array())) {
+		v8::ThrowException(v8::Exception::TypeError(v8::String::New("Usage: native.sort(Float64Array|Int32Array)")));
+		return;
+	}
+
+	v8::Handle<v8::TypedArray> array = v8::Handle<v8::TypedArray>::Cast(args[0]);
+	void* data = array->BaseAddress();
+	size_t length = array->Length();
+	bool isFloat = args[0]->IsFloat64Array();
+
+	WorkerPool &pool = *Extension::Get().workerPool;
+
+	Unlocked(isolate, length, [&]() {
+
+		std::vector<size_t> bounds = Chunks(length);
+
+		if (isFloat) {
+			ParallelSort(pool, static_cast<double*>(data), bounds, static_cast<bool (*)(double, double)>(Less));
+		}
+		else {
+			ParallelSort(pool, static_cast<int32*>(data), bounds, static_cast<bool (*)(int32, int32)>(Less));
+		}
+	});
+
+	Metrics::Get().Add("native.sorted", static_cast<double>(length));
+
+	args.GetReturnValue().Set(array);
+}
+
+// native.argsort(array)
+void NativeKernels::Argsort(const v8::FunctionCallbackInfo<v8::Value>& args) {
+
+	v8::Isolate* isolate = args.GetIsolate();
+	v8::HandleScope handleScope(isolate);
+
+	if (args.Length() < 1 || !(args[0]->IsFloat64Array() || args[0]->IsInt32Array())) {
+		v8::ThrowException(v8::Exception::TypeError(v8::String::New("Usage: native.argsort(Float64Array|Int32Array)")));
+		return;
+	}
+
+	v8::Handle<v8::TypedArray> array = v8::Handle<v8::TypedArray>::Cast(args[0]);
+	void* data = array->BaseAddress();
+	size_t length = array->Length();
+	bool isFloat = args[0]->IsFloat64Array();
+
+	// Indices are written directly into the result array
+	v8::Local<v8::Int32Array> result = v8::Int32Array::New(v8::ArrayBuffer::New(length * sizeof(int32)), 0, length);
+	int32* indices = static_cast<int32*>(result->BaseAddress());
+
+	WorkerPool &pool = *Extension::Get().workerPool;
+
+	Unlocked(isolate, length, [&]() {
+
+		for (size_t i = 0; i < length; i++) {
+			indices[i] = static_cast<int32>(i);
+		}
+
+		std::vector<size_t> bounds = Chunks(length);
+
+		// Equal elements keep their original order
+		if (isFloat) {
+
+			const double* elements = static_cast<const double*>(data);
+
+			ParallelSort(pool, indices, bounds, [elements](int32 a, int32 b) {
+				return Less(elements[a], elements[b]) || (!Less(elements[b], elements[a]) && a < b);
+			});
+		}
+		else {
+
+			const int32* elements = static_cast<const int32*>(data);
+
+			ParallelSort(pool, indices, bounds, [elements](int32 a, int32 b) {
+				return elements[a] < elements[b] || (elements[a] == elements[b] && a < b);
+			});
+		}
+	});
+
+	Metrics::Get().Add("native.sorted", static_cast<double>(length));
+
+	args.GetReturnValue().Set(result);
+}
+
+// native.reduce(array, operation)
+void NativeKernels::Reduce(const v8::FunctionCallbackInfo<v8::Value>& args) {
+
+	v8::Isolate* isolate = args.GetIsolate();
+	v8::HandleScope handleScope(isolate);
+
+	if (args.Length() < 1 || !(args[0]->IsFloat64Array() || args[0]->IsInt32Array())) {
+		v8::ThrowException(v8::Exception::TypeError(v8::String::New("Usage: native.reduce(Float64Array|Int32Array, \"sum\"|\"min\"|\"max\"|\"mean\")")));
+		return;
+	}
+
+	std::string operation("sum");
+
+	if (args.Length() > 1 && args[1]->IsString()) {
+		operation = *v8::String::Utf8Value(args[1]);
+	}
+
+	bool isMin = (operation == "min");
+	bool isMax = (operation == "max");
+	bool isMean = (operation == "mean");
+
+	if (!isMin && !isMax && !isMean && operation != "sum") {
+		v8::ThrowException(v8::Exception::TypeError(v8::String::New("native.reduce() operation must be \"sum\", \"min\", \"max\" or \"mean\"")));
+		return;
+	}
+
+	v8::Handle<v8::TypedArray> array = v8::Handle<v8::TypedArray>::Cast(args[0]);
+	void* data = array->BaseAddress();
+	size_t length = array->Length();
+	bool isFloat = args[0]->IsFloat64Array();
+
+	double result = 0;
+
+	WorkerPool &pool = *Extension::Get().workerPool;
+
+	Unlocked(isolate, length, [&]() {
+
+		std::vector<size_t> bounds = Chunks(length);
+
+		if (isFloat) {
+			result = ParallelReduce(pool, static_cast<const double*>(data), bounds, isMin, isMax);
+		}
+		else {
+			result = ParallelReduce(pool, static_cast<const int32*>(data), bounds, isMin, isMax);
+		}
+	});
+
+	// Mean of an empty array is NaN (same as 0 / 0 in JavaScript)
+	if (isMean) {
+		result = (length > 0) ? result / length : std::numeric_limits<double>::quiet_NaN();
+	}
+
+	Metrics::Get().Add("native.reduced", static_cast<double>(length));
+
+	args.GetReturnValue().Set(v8::Number::New(result));
+}
+
+// native.histogram(array, bins, min, max)
+void NativeKernels::Histogram(const v8::FunctionCallbackInfo<v8::Value>& args) {
+
+	v8::Isolate* isolate = args.GetIsolate();
+	v8::HandleScope handleScope(isolate);
+
+	if (args.Length() < 1 || !(args[0]->IsFloat64Array() || args[0]->IsInt32Array())) {
+		v8::ThrowException(v8::Exception::TypeError(v8::String::New("Usage: native.histogram(Float64Array|Int32Array, bins, min, max)")));
+		return;
+	}
+
+	size_t bins = 10;
+
+	if (args.Length() > 1 && args[1]->IsNumber()) {
+
+		double value = args[1]->NumberValue();
+
+		if (value > NATIVE_KERNELS_MAX_BINS) {
+			v8::ThrowException(v8::Exception::RangeError(v8::String::New("native.histogram() supports up to 65536 bins")));
+			return;
+		}
+
+		if (value >= 1) {
+			bins = static_cast<size_t>(value);
+		}
+	}
+
+	// Element range is used by default
+	bool hasRange = args.Length() > 3 && args[2]->IsNumber() && args[3]->IsNumber();
+	double minValue = hasRange ? args[2]->NumberValue() : 0;
+	double maxValue = hasRange ? args[3]->NumberValue() : 0;
+
+	v8::Handle<v8::TypedArray> array = v8::Handle<v8::TypedArray>::Cast(args[0]);
+	void* data = array->BaseAddress();
+	size_t length = array->Length();
+	bool isFloat = args[0]->IsFloat64Array();
+
+	std::vector<uint32> counts(bins, 0);
+
+	WorkerPool &pool = *Extension::Get().workerPool;
+
+	Unlocked(isolate, length, [&]() {
+
+		std::vector<size_t> bounds = Chunks(length);
+
+		if (isFloat) {
+
+			const double* elements = static_cast<const double*>(data);
+
+			if (!hasRange) {
+				minValue = ParallelReduce(pool, elements, bounds, true, false);
+				maxValue = ParallelReduce(pool, elements, bounds, false, true);
+			}
+
+			ParallelHistogram(pool, elements, bounds, minValue, maxValue, counts);
+		}
+		else {
+
+			const int32* elements = static_cast<const int32*>(data);
+
+			if (!hasRange) {
+				minValue = ParallelReduce(pool, elements, bounds, true, false);
+				maxValue = ParallelReduce(pool, elements, bounds, false, true);
+			}
+
+			ParallelHistogram(pool, elements, bounds, minValue, maxValue, counts);
+		}
+	});
+
+	v8::Local<v8::Int32Array> result = v8::Int32Array::New(v8::ArrayBuffer::New(bins * sizeof(int32)), 0, bins);
+	int32* resultCounts = static_cast<int32*>(result->BaseAddress());
+
+	for (size_t bin = 0; bin < bins; bin++) {
+		resultCounts[bin] = static_cast<int32>(counts[bin]);
+	}
+
+	Metrics::Get().Add("native.histogrammed", static_cast<double>(length));
+
+	args.GetReturnValue().Set(result);
+}
+
+// Run work without holding the isolate lock
+void NativeKernels::Unlocked(v8::Isolate* isolate, size_t length, std::function<void ()> work) {
+
+	if (length < NATIVE_KERNELS_UNLOCK_LENGTH) {
+		work();
+		return;
+	}
+
+	double startTime = Metrics::Now();
+
+	// Let other threads use this isolate while the numbers are crunched
+	JavaScript::Unlocked(isolate, work);
+
+	Metrics::Get().Add("native.unlockedTime", Metrics::Now() - startTime);
+}
+
+// Split array elements into chunks for the worker threads
+std::vector<size_t> NativeKernels::Chunks(size_t length) {
+
+	size_t workers = Extension::Get().workerPool->Size();
+	size_t chunks = max(min(workers, length / NATIVE_KERNELS_CHUNK_LENGTH), static_cast<size_t>(1));
+
+	std::vector<size_t> bounds(chunks + 1);
+
+	for (size_t chunk = 0; chunk <= chunks; chunk++) {
+		bounds[chunk] = length * chunk / chunks;
+	}
+
+	return bounds;
+}
\ No newline at end of file
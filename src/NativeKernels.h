@@ -0,0 +1,60 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+
+#include <functional>
+#include <vector>
+
+// Native numeric kernels over Float64Array/Int32Array (native module)
+// NOTE: Large arrays are processed on the worker threads without holding the isolate lock,
+// other scripts may run (and must not modify the same array) in the meantime
+class NativeKernels {
+
+public:
+
+	// Register native as a lazily installed native module
+	static void Register();
+
+	// Create native module object (on first access)
+	static v8::Handle<v8::Value> Create();
+
+protected:
+
+	// native.sort(array) sorts array in place (ascending, NaN last) and returns it
+	static void Sort(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// native.argsort(array) returns Int32Array of element indices in sorted order (stable)
+	static void Argsort(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// native.reduce(array, operation) returns "sum" (default), "min", "max" or "mean" of the elements
+	static void Reduce(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// native.histogram(array, bins, min, max) returns Int32Array of element counts per bin (NaN and out of range elements are skipped)
+	// NOTE: Throws RangeError for more than 65536 bins
+	static void Histogram(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// Run work without holding the isolate lock (small arrays are processed while holding it)
+	static void Unlocked(v8::Isolate* isolate, size_t length, std::function<void ()> work);
+
+	// Split array elements into chunks for the worker threads (chunk bounds, one more than chunks)
+	static std::vector<size_t> Chunks(size_t length);
+};
\ No newline at end of file
@@ -0,0 +1,92 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Natives.h"
+#include "Metrics.h"
+
+// Register native module object
+void Natives::Register(const char* name, Initializer initializer) {
+
+	Module module;
+	module.name = name;
+	module.initializer = initializer;
+	module.callback = NULL;
+
+	modules.push_back(module);
+}
+
+// Register native global function
+void Natives::Register(const char* name, v8::FunctionCallback callback) {
+
+	Module module;
+	module.name = name;
+	module.initializer = NULL;
+	module.callback = callback;
+
+	modules.push_back(module);
+}
+
+// Install lazy accessors for all registered native modules
+void Natives::Install(v8::Handle<v8::ObjectTemplate> global) {
+
+	v8::PropertyAttribute builtInPropAttr = (v8::PropertyAttribute)(v8::DontDelete | v8::ReadOnly);
+
+	for (size_t i = 0; i < modules.size(); i++) {
+
+		// NOTE: No templates or objects are created until the first property access
+		global->SetAccessor(v8::String::NewSymbol(modules[i].name.c_str()), Natives::Getter, 0, v8::Integer::New((int32)i), v8::DEFAULT, builtInPropAttr);
+	}
+}
+
+// Lazy native module accessor (creates the module on first access)
+void Natives::Getter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value>& info) {
+
+	v8::Local<v8::Object> holder = info.Holder();
+
+	// Native module is cached on the global object (per context)
+	v8::Local<v8::Value> value = holder->GetHiddenValue(property);
+
+	if (!value.IsEmpty()) {
+		info.GetReturnValue().Set(value);
+		return;
+	}
+
+	Natives &natives = Natives::Get();
+	const Module &module = natives.modules[info.Data()->Int32Value()];
+
+	double startTime = Metrics::Now();
+
+	v8::Handle<v8::Value> moduleValue;
+
+	if (module.initializer != NULL) {
+		moduleValue = module.initializer();
+	}
+	else {
+		moduleValue = v8::FunctionTemplate::New(module.callback)->GetFunction();
+	}
+
+	// Report per-module initialization cost
+	Metrics &metrics = Metrics::Get();
+	metrics.Add("natives." + module.name + ".initCount");
+	metrics.Add("natives." + module.name + ".initTime", Metrics::Now() - startTime);
+
+	holder->SetHiddenValue(property, moduleValue);
+
+	info.GetReturnValue().Set(moduleValue);
+}
\ No newline at end of file
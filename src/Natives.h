@@ -0,0 +1,64 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+#include "Singleton.h"
+
+#include <vector>
+
+// Registry of native (C++) modules installed lazily on the global object
+class Natives: public Singleton<Natives> {
+
+public:
+
+	// Native module initializer (creates module value in the current context)
+	typedef v8::Handle<v8::Value> (*Initializer)();
+
+	// Register native module object
+	void Register(const char* name, Initializer initializer);
+
+	// Register native global function
+	void Register(const char* name, v8::FunctionCallback callback);
+
+	// Install lazy accessors for all registered native modules
+	void Install(v8::Handle<v8::ObjectTemplate> global);
+
+protected:
+
+	// Lazy native module accessor (creates the module on first access)
+	static void Getter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value>& info);
+
+private:
+
+	// Registered native module
+	struct Module {
+
+		// Global property name
+		std::string name;
+
+		// Module object initializer or global function callback
+		Initializer initializer;
+		v8::FunctionCallback callback;
+	};
+
+	// Registered native modules (accessor data is an index into this list)
+	std::vector<Module> modules;
+};
\ No newline at end of file
@@ -0,0 +1,154 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+
+#include <atomic>
+
+// Bounded lock-free multi-producer/multi-consumer ring buffer
+// NOTE: Each cell has a sequence number that tells producers and consumers
+// whether it is free for the current lap (capacity is a power of two)
+template<class T>
+class RingBuffer {
+
+public:
+
+	RingBuffer(size_t capacity): enqueuePosition(0), dequeuePosition(0) {
+
+		size_t size = Round(capacity);
+
+		mask = size - 1;
+		cells.reset(new Cell[size]);
+
+		for (size_t i = 0; i < size; i++) {
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	// Add value to the buffer (returns false if the buffer is full)
+	bool Push(T &value) {
+
+		size_t position = enqueuePosition.load(std::memory_order_relaxed);
+		Cell* cell;
+
+		while (true) {
+
+			cell = &cells[position & mask];
+
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr difference = static_cast<intptr>(sequence) - static_cast<intptr>(position);
+
+			// Cell is free, try to claim it
+			if (difference == 0) {
+
+				if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			// Buffer is full
+			else if (difference < 0) {
+				return false;
+			}
+			// Another producer claimed the cell
+			else {
+				position = enqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		std::swap(cell->value, value);
+		cell->sequence.store(position + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// Remove value from the buffer (returns false if the buffer is empty)
+	bool Pop(T &value) {
+
+		size_t position = dequeuePosition.load(std::memory_order_relaxed);
+		Cell* cell;
+
+		while (true) {
+
+			cell = &cells[position & mask];
+
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr difference = static_cast<intptr>(sequence) - static_cast<intptr>(position + 1);
+
+			// Cell is filled, try to claim it
+			if (difference == 0) {
+
+				if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			// Buffer is empty
+			else if (difference < 0) {
+				return false;
+			}
+			// Another consumer claimed the cell
+			else {
+				position = dequeuePosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		value = T();
+		std::swap(cell->value, value);
+		cell->sequence.store(position + mask + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// Actual capacity of a buffer created with a given capacity (rounded up to a power of two)
+	// NOTE: Callers must bound the capacity (size would wrap to 0 past the highest power of two)
+	static size_t Round(size_t capacity) {
+
+		size_t size = 2;
+
+		while (size < capacity) {
+			size <<= 1;
+		}
+
+		return size;
+	}
+
+	// Buffer capacity
+	size_t Capacity() const {
+		return mask + 1;
+	}
+
+private:
+
+	// Buffer cell
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	unique_ptr<Cell[]> cells;
+	size_t mask;
+
+	// Producer and consumer positions (on separate cache lines)
+	char padding0[64];
+	std::atomic<size_t> enqueuePosition;
+	char padding1[64];
+	std::atomic<size_t> dequeuePosition;
+	char padding2[64];
+};
\ No newline at end of file
@@ -0,0 +1,507 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Runtime.h"
+#include "Extension.h"
+#include "CurlEngine.h"
+#include "Modules.h"
+#include "SandboxPool.h"
+#include "EventLoop.h"
+#include "Natives.h"
+#include "Metrics.h"
+#include "Settings.h"
+
+#include <chrono>
+
+// Megabytes and kilobytes (for heap and stack settings)
+#define RUNTIME_MB (1024 * 1024)
+#define RUNTIME_KB 1024
+
+// Metrics name of the default runtime
+#define RUNTIME_DEFAULT_NAME "default"
+
+// Largest IdleNotification() hint per step (small hints only do incremental marking steps)
+#define RUNTIME_IDLE_HINT 10
+
+// Start time of the current garbage collection (GC runs on the thread holding the isolate lock)
+__declspec(thread) static double gcStartTime = 0;
+
+// Constructor
+Runtime::Runtime(const std::string &name): name(name), isolate(NULL), preemptionSlice(0), stackSize(0), memoryWatermark(0), memoryThreshold(0), isCompactPending(false), isIsolateOwner(false), mainThreadWaiting(0), backgroundLocks(0) {
+
+	// Default namespace uses the default V8 isolate
+	if (name.empty()) {
+		isolate = v8::Isolate::GetCurrent();
+	}
+	// Any other namespace gets a separate V8 isolate
+	else {
+		isolate = v8::Isolate::New();
+		isIsolateOwner = true;
+	}
+
+	double startTime = Metrics::Now();
+
+	v8::Locker locker(isolate); // Critical section
+	v8::Isolate::Scope isolateScope(isolate);
+
+	isolate->SetData(this);
+
+	for (int i = 0; i < JS_PRIORITY_CLASSES; i++) {
+		priorityWaiting[i] = 0;
+	}
+
+	Settings &settings = Settings::Get();
+	Metrics &metrics = Metrics::Get();
+
+	// Heap limits (must be applied before the isolate heap is used)
+	v8::ResourceConstraints constraints;
+	constraints.set_max_young_space_size(settings.GetIsolateInt(name, "MaxYoungSpaceSize", 0) * RUNTIME_MB);
+	constraints.set_max_old_space_size(settings.GetIsolateInt(name, "MaxOldSpaceSize", 0) * RUNTIME_MB);
+	constraints.set_max_executable_size(settings.GetIsolateInt(name, "MaxExecutableSize", 0) * RUNTIME_MB);
+
+	if (constraints.max_young_space_size() || constraints.max_old_space_size() || constraints.max_executable_size()) {
+
+		if (!v8::SetResourceConstraints(&constraints)) {
+			metrics.Add("runtime.constraintsFailed");
+		}
+	}
+
+	stackSize = settings.GetIsolateInt(name, "StackSize", 0) * RUNTIME_KB;
+
+	SetStackLimit();
+
+	// Automatic heap compaction
+	memoryWatermark = static_cast<size_t>(max(settings.GetIsolateInt(name, "MemoryWatermark", 0), 0)) * RUNTIME_MB;
+	memoryThreshold = memoryWatermark;
+
+	// Opt-in preemptive time slicing (lock rotates between threads waiting for this isolate)
+	preemptionSlice = settings.GetIsolateInt(name, "PreemptionSlice", 0);
+
+	if (preemptionSlice > 0) {
+		v8::Locker::StartPreemption(preemptionSlice);
+	}
+
+	v8::V8::AddGCPrologueCallback(Runtime::GCPrologue);
+	v8::V8::AddGCEpilogueCallback(Runtime::GCEpilogue);
+
+	v8::HandleScope handleScope(isolate);
+
+	// Create a template for the global object
+	v8::Handle<v8::ObjectTemplate> global = v8::ObjectTemplate::New();
+
+	// Native modules are installed lazily (created on first access)
+	Natives::Get().Install(global);
+
+	// require() function with module hot reload
+	modules.reset(new Modules(isolate, context));
+	modules->Register(global);
+
+	// Create V8 execution context
+	context.Reset(isolate, v8::Context::New(isolate, NULL, global));
+
+	// Pre-created sandbox contexts (from the same global template)
+	sandboxes.reset(new SandboxPool(isolate, global, *modules, settings.GetIsolateInt(name, "SandboxPoolSize", 2), settings.GetIsolateInt(name, "SandboxMaxUses", 100)));
+
+	// Event loop thread is started on the first scheduled timer
+	eventLoop.reset(new EventLoop(this, settings.GetIsolateInt(name, "TimerResolution", 10)));
+
+	metrics.Add("runtime.count");
+	metrics.Add("runtime.initTime", Metrics::Now() - startTime);
+}
+
+// Set V8 stack limit for the current thread
+void Runtime::SetStackLimit() {
+
+	if (stackSize <= 0) {
+		return;
+	}
+
+	// Stack grows down from the current position
+	uint32 stackPosition;
+
+	v8::ResourceConstraints constraints;
+	constraints.set_stack_limit(reinterpret_cast<uint32*>(reinterpret_cast<char*>(&stackPosition) - stackSize));
+
+	v8::SetResourceConstraints(&constraints);
+}
+
+// Flag main thread as waiting for (and holding) the isolate lock
+Runtime::MainThreadScope::MainThreadScope(Runtime* runtime): runtime(runtime), startTime(Metrics::Now()) {
+	runtime->mainThreadWaiting++;
+}
+
+// Record lock wait time (call after the isolate lock is acquired)
+void Runtime::MainThreadScope::Locked() {
+
+	double waitTime = Metrics::Now() - startTime;
+
+	Metrics &metrics = Metrics::Get();
+	metrics.Add("lock.mainWaitTime", waitTime);
+	metrics.Max("lock.mainWaitTimeMax", waitTime);
+}
+
+// Main thread exec is done (isolate lock was released)
+Runtime::MainThreadScope::~MainThreadScope() {
+
+	{
+		std::lock_guard<std::mutex> lock(runtime->mainThreadMutex);
+		runtime->mainThreadWaiting--;
+	}
+
+	runtime->mainThreadCondition.notify_all();
+}
+
+// Main thread gives up its lock priority while it is blocked in native code
+void Runtime::SuspendMainThreadPriority() {
+
+	{
+		std::lock_guard<std::mutex> lock(mainThreadMutex);
+		mainThreadWaiting--;
+	}
+
+	mainThreadCondition.notify_all();
+}
+
+// Main thread takes its lock priority back (before it re-acquires the isolate lock)
+void Runtime::ResumeMainThreadPriority() {
+	mainThreadWaiting++;
+}
+
+// Wait until the main thread is done with the isolate
+void Runtime::WaitForMainThread() {
+
+	if (mainThreadWaiting == 0) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mainThreadMutex);
+
+	while (mainThreadWaiting > 0) {
+		mainThreadCondition.wait(lock);
+	}
+}
+
+// Wait for the isolate lock turn of a background script (after the main thread and higher priority scripts)
+void Runtime::WaitForTurn(int priority, int agingTime) {
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(agingTime);
+
+	std::unique_lock<std::mutex> lock(mainThreadMutex);
+
+	priorityWaiting[priority]++;
+
+	while (true) {
+
+		// Main thread always goes first
+		if (mainThreadWaiting > 0) {
+			mainThreadCondition.wait(lock);
+			continue;
+		}
+
+		bool isHigherWaiting = false;
+
+		for (int i = 0; i < priority; i++) {
+			isHigherWaiting = isHigherWaiting || priorityWaiting[i] > 0;
+		}
+
+		// Aged scripts compete for the lock like any other
+		if (!isHigherWaiting || std::chrono::steady_clock::now() >= deadline) {
+			break;
+		}
+
+		mainThreadCondition.wait_until(lock, deadline);
+	}
+}
+
+// Background script got the isolate lock after WaitForTurn()
+void Runtime::TurnTaken(int priority) {
+
+	{
+		std::lock_guard<std::mutex> lock(mainThreadMutex);
+
+		// Script moves from waiting to holding the lock at once (Idle() never sees it as neither)
+		priorityWaiting[priority]--;
+		backgroundLocks++;
+	}
+
+	mainThreadCondition.notify_all();
+}
+
+// Background thread got (or is about to release) the isolate lock
+void Runtime::BackgroundLocked(bool isLocked) {
+
+	if (isLocked) {
+		backgroundLocks++;
+	}
+	else {
+		backgroundLocks--;
+	}
+}
+
+// Background scripts are running (or waiting) in this isolate
+bool Runtime::IsBackgroundBusy() {
+
+	// NOTE: Checked under the main thread mutex, TurnTaken() moves scripts from waiting to holding the lock under it
+	std::lock_guard<std::mutex> lock(mainThreadMutex);
+
+	if (backgroundLocks > 0) {
+		return true;
+	}
+
+	for (int i = 0; i < JS_PRIORITY_CLASSES; i++) {
+
+		if (priorityWaiting[i] > 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Yield the isolate lock to a waiting main thread (returns true if yielded)
+bool Runtime::Yield() {
+
+	if (mainThreadWaiting == 0) {
+		return false;
+	}
+
+	{
+		isolate->Exit();
+		v8::Unlocker unlocker(isolate);
+
+		WaitForMainThread();
+	}
+
+	isolate->Enter();
+
+	// Stack limit is per thread, but the main thread may have changed it
+	SetStackLimit();
+
+	Metrics::Get().Add("lock.yields");
+
+	return true;
+}
+
+// Preemptive time slicing is enabled (lock may switch threads at any time)
+bool Runtime::IsPreemptive() const {
+	return preemptionSlice > 0;
+}
+
+// Spend idle time (in milliseconds) on garbage collection while background scripts are suspended
+bool Runtime::Idle(int idleTime) {
+
+	double startTime = Metrics::Now();
+	double deadline = startTime + idleTime * 1000.0;
+
+	bool isDone = false;
+	int notifications = 0;
+
+	std::string prefix("gc.");
+	prefix += GetMetricsName();
+
+	Metrics &metrics = Metrics::Get();
+
+	{
+		// Background scripts do not get the isolate lock back until the idle time is over
+		MainThreadScope mainThreadScope(this);
+
+		// Idle hint must never be slower than doing nothing (waiting for a running script to release the lock)
+		// NOTE: Checked after the main thread priority is set, so scripts that did not get the lock yet keep waiting
+		if (IsBackgroundBusy()) {
+
+			metrics.Add(prefix + ".idleSkipped");
+			return false;
+		}
+
+		v8::Locker locker(isolate); // Critical section
+		v8::Isolate::Scope isolateScope(isolate);
+
+		mainThreadScope.Locked();
+
+		// Watermark compaction deferred by a main thread exec (idle time is the place for it)
+		if (isCompactPending) {
+
+			isCompactPending = false;
+
+			size_t usedBefore;
+			size_t usedAfter;
+
+			Compact(usedBefore, usedAfter);
+
+			metrics.Add(prefix + ".watermarkCompactions");
+		}
+
+		// Small incremental GC steps until the idle time is used up
+		// NOTE: Hint is a work scale (not milliseconds), 100 and above may start a full GC
+		double stepTime = 0;
+
+		while (!isDone) {
+
+			double now = Metrics::Now();
+
+			// Next step would overrun the idle time (measured by the last one)
+			if (now + stepTime > deadline) {
+				break;
+			}
+
+			int remainingTime = static_cast<int>((deadline - now) / 1000);
+
+			isDone = v8::V8::IdleNotification(min(max(remainingTime, 1), RUNTIME_IDLE_HINT));
+			notifications++;
+
+			stepTime = Metrics::Now() - now;
+		}
+	}
+
+	metrics.Add(prefix + ".idleNotifications", notifications);
+	metrics.Add(prefix + ".idleTime", Metrics::Now() - startTime);
+
+	return isDone;
+}
+
+// Release as much memory as possible (shed native caches and compact the heap)
+void Runtime::Compact(size_t &usedBefore, size_t &usedAfter) {
+
+	double startTime = Metrics::Now();
+
+	usedBefore = GetUsedHeapSize();
+
+	// Idle sandbox contexts hold their own globals and built-ins
+	size_t sandboxesShed = sandboxes->Shed();
+
+	// Idle curl handles keep their connections and buffers (process-wide, shed by any runtime)
+	size_t curlHandlesShed = Extension::Get().curlEngine->Shed();
+
+	// Full (compacting) GC of all spaces
+	v8::V8::LowMemoryNotification();
+
+	usedAfter = GetUsedHeapSize();
+
+	// Live data is not compacted again until the heap grows by half of it
+	memoryThreshold = max(memoryWatermark, usedAfter + usedAfter / 2);
+
+	std::string prefix("gc.");
+	prefix += GetMetricsName();
+
+	Metrics &metrics = Metrics::Get();
+	metrics.Add(prefix + ".compactions");
+	metrics.Add(prefix + ".compactTime", Metrics::Now() - startTime);
+	metrics.Add(prefix + ".freedBytes", usedBefore > usedAfter ? static_cast<double>(usedBefore - usedAfter) : 0.0);
+	metrics.Add(prefix + ".sandboxesShed", static_cast<double>(sandboxesShed));
+	metrics.Add(prefix + ".curlHandlesShed", static_cast<double>(curlHandlesShed));
+}
+
+// Compact the heap if it has grown past the memory watermark
+void Runtime::CheckMemory() {
+
+	if (memoryWatermark == 0 || (!isCompactPending && GetUsedHeapSize() <= memoryThreshold)) {
+		return;
+	}
+
+	// Full compaction takes several mark-compacts, SQF frame must not wait for it
+	if (std::this_thread::get_id() == Extension::Get().mainThreadID) {
+
+		if (!isCompactPending) {
+
+			isCompactPending = true;
+			Metrics::Get().Add(std::string("gc.") + GetMetricsName() + ".watermarkDeferred");
+		}
+
+		return;
+	}
+
+	isCompactPending = false;
+
+	size_t usedBefore;
+	size_t usedAfter;
+
+	Compact(usedBefore, usedAfter);
+
+	Metrics::Get().Add(std::string("gc.") + GetMetricsName() + ".watermarkCompactions");
+}
+
+// Get used heap size (in bytes)
+size_t Runtime::GetUsedHeapSize() {
+
+	v8::HeapStatistics heapStatistics;
+	isolate->GetHeapStatistics(&heapStatistics);
+
+	return heapStatistics.used_heap_size();
+}
+
+// Runtime name used in metrics
+const char* Runtime::GetMetricsName() const {
+	return name.empty() ? RUNTIME_DEFAULT_NAME : name.c_str();
+}
+
+// Garbage collection start
+void Runtime::GCPrologue(v8::GCType type, v8::GCCallbackFlags flags) {
+	gcStartTime = Metrics::Now();
+}
+
+// Garbage collection end
+void Runtime::GCEpilogue(v8::GCType type, v8::GCCallbackFlags flags) {
+
+	double pauseTime = Metrics::Now() - gcStartTime;
+
+	Runtime* runtime = static_cast<Runtime*>(v8::Isolate::GetCurrent()->GetData());
+
+	std::string prefix("gc.");
+	prefix += (runtime == NULL) ? RUNTIME_DEFAULT_NAME : runtime->GetMetricsName();
+
+	// Report GC pause times per runtime
+	Metrics &metrics = Metrics::Get();
+	metrics.Add(prefix + ".count");
+	metrics.Add(prefix + ".pauseTime", pauseTime);
+	metrics.Max(prefix + ".pauseTimeMax", pauseTime);
+}
+
+// Destructor
+Runtime::~Runtime() {
+
+	// Event loop thread acquires the isolate lock, so it has to be stopped first
+	eventLoop->Stop();
+
+	{
+		v8::Locker locker(isolate); // Critical section
+		v8::Isolate::Scope isolateScope(isolate);
+
+		// Stop module watcher and release loaded modules
+		modules.reset();
+
+		// Release sandbox contexts
+		sandboxes.reset();
+
+		// Release pending timer callbacks
+		eventLoop.reset();
+
+		// Stop preemption thread of this isolate
+		if (preemptionSlice > 0) {
+			v8::Locker::StopPreemption();
+		}
+
+		// Release V8 execution context handle
+		context.Dispose();
+		context.Clear();
+	}
+
+	if (isIsolateOwner) {
+		isolate->Dispose();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,169 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+
+#include <atomic>
+#include <condition_variable>
+
+class Modules;
+class SandboxPool;
+class EventLoop;
+
+// JavaScript runtime: V8 isolate with its own execution context and lock
+class Runtime {
+
+public:
+
+	// Create runtime for a namespace (empty name uses the default V8 isolate)
+	Runtime(const std::string &name);
+	~Runtime();
+
+	// Namespace name (e.g. ARMA addon PBO prefix)
+	const std::string name;
+
+	// V8 isolate and execution context
+	// NOTE: Each isolate has its own v8::Locker, so different runtimes can run in parallel
+	v8::Isolate* isolate;
+	v8::Persistent<v8::Context> context;
+
+	// JavaScript module loader
+	unique_ptr<Modules> modules;
+
+	// Pooled sandbox contexts (only used while holding the isolate lock)
+	unique_ptr<SandboxPool> sandboxes;
+
+	// Timer callbacks (setTimeout, setInterval and setImmediate)
+	unique_ptr<EventLoop> eventLoop;
+
+	// Set V8 stack limit for the current thread
+	// NOTE: Must be called by every thread after it acquires the isolate lock
+	void SetStackLimit();
+
+	// Main thread lock priority (background threads defer to a waiting main thread exec)
+	// NOTE: A running background script is only interrupted when preemption is enabled (PreemptionSlice),
+	// V8 then releases its lock at stack guard safe points. Otherwise the main thread waits until the
+	// script releases the lock itself (sleep(), blocking natives, waits or the end of the script).
+	// NOTE: Preemption also slices a main thread exec (the lock is handed to a waiting background thread
+	// for a slice). Locks retaken at slice boundaries bypass WaitForTurn, so main thread priority does not apply there.
+	class MainThreadScope {
+
+	public:
+
+		// Flag main thread as waiting for (and holding) the isolate lock
+		MainThreadScope(Runtime* runtime);
+		~MainThreadScope();
+
+		// Record lock wait time (call after the isolate lock is acquired)
+		void Locked();
+
+	private:
+
+		Runtime* runtime;
+		double startTime;
+	};
+
+	// Main thread gives up its lock priority while it is blocked in native code (and takes it back)
+	// NOTE: Must only be called by the main thread during an exec (within MainThreadScope)
+	void SuspendMainThreadPriority();
+	void ResumeMainThreadPriority();
+
+	// Wait until the main thread is done with the isolate
+	// NOTE: Must be called by background threads before they acquire the isolate lock
+	void WaitForMainThread();
+
+	// Wait for the isolate lock turn of a background script (after the main thread and higher priority scripts)
+	// NOTE: Higher priority scripts are only waited for up to the aging time (in milliseconds)
+	void WaitForTurn(int priority, int agingTime);
+
+	// Background script got the isolate lock after WaitForTurn() (counted as a background lock owner until it is released)
+	void TurnTaken(int priority);
+
+	// Background thread got (or is about to release) the isolate lock (background scripts and event loop)
+	// NOTE: Only used to tell if the main thread would have to wait for the lock (V8 has no try-lock)
+	void BackgroundLocked(bool isLocked);
+
+	// Yield the isolate lock to a waiting main thread (returns true if yielded)
+	// NOTE: Cooperative yield point of native code (e.g. between event loop callbacks), must be called while holding the isolate lock
+	bool Yield();
+
+	// Preemptive time slicing is enabled (lock may switch threads at any time)
+	bool IsPreemptive() const;
+
+	// Spend idle time (in milliseconds) on garbage collection while background scripts are suspended
+	// NOTE: Returns true if V8 has done all the cleanup it can (until more work is done), skipped while background scripts are busy
+	bool Idle(int idleTime);
+
+	// Release as much memory as possible (shed native caches and compact the heap)
+	// NOTE: Must be called while holding the isolate lock (used heap size in bytes is reported before and after)
+	void Compact(size_t &usedBefore, size_t &usedAfter);
+
+	// Compact the heap if it has grown past the memory watermark
+	// NOTE: Must be called while holding the isolate lock, the main thread only flags the compaction (done by Idle() or a background script)
+	void CheckMemory();
+
+protected:
+
+	// Garbage collection pause tracking
+	static void GCPrologue(v8::GCType type, v8::GCCallbackFlags flags);
+	static void GCEpilogue(v8::GCType type, v8::GCCallbackFlags flags);
+
+	// Background scripts are running (or waiting) in this isolate, the main thread would wait for the lock
+	bool IsBackgroundBusy();
+
+	// Get used heap size (in bytes)
+	size_t GetUsedHeapSize();
+
+	// Runtime name used in metrics
+	const char* GetMetricsName() const;
+
+private:
+
+	// Preemption time slice (in milliseconds, 0 when disabled)
+	int preemptionSlice;
+
+	// Stack size limit for V8 (in bytes, 0 for V8 default)
+	int stackSize;
+
+	// Used heap size that triggers automatic compaction (in bytes, 0 when disabled)
+	// NOTE: The threshold is raised above the heap size that survived the last compaction
+	size_t memoryWatermark;
+	size_t memoryThreshold;
+
+	// Heap has grown past the watermark during a main thread exec (compaction would hitch the frame)
+	// NOTE: Guarded by the isolate lock
+	bool isCompactPending;
+
+	// Isolate is owned (and disposed) by this runtime
+	bool isIsolateOwner;
+
+	// Number of main thread execs waiting for (or holding) the isolate lock
+	std::atomic<int> mainThreadWaiting;
+	std::mutex mainThreadMutex;
+	std::condition_variable mainThreadCondition;
+
+	// Number of background scripts waiting for the isolate lock (per priority class)
+	// NOTE: Guarded by the main thread mutex
+	int priorityWaiting[JS_PRIORITY_CLASSES];
+
+	// Number of background threads holding the isolate lock
+	std::atomic<int> backgroundLocks;
+};
\ No newline at end of file
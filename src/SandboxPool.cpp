@@ -0,0 +1,178 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SandboxPool.h"
+#include "Modules.h"
+#include "Metrics.h"
+
+// Constructor
+SandboxPool::SandboxPool(v8::Isolate* isolate, v8::Handle<v8::ObjectTemplate> global, Modules &modules, int size, int maxUses):
+	isolate(isolate), modules(modules), size(size), maxUses(maxUses) {
+
+	v8::HandleScope handleScope(isolate);
+
+	this->global.Reset(isolate, global);
+
+	// Pre-create sandbox contexts
+	for (int i = 0; i < size; i++) {
+		idle.push_back(Create());
+	}
+}
+
+// Check out a sandbox from the pool (creates a new one if the pool is empty)
+shared_ptr<SandboxPool::Sandbox> SandboxPool::Acquire() {
+
+	shared_ptr<Sandbox> sandbox;
+
+	if (idle.empty()) {
+		sandbox = Create();
+	}
+	else {
+		sandbox = idle.back();
+		idle.pop_back();
+	}
+
+	sandbox->uses++;
+
+	// Modules required by previous checkouts (and changes made to them) are not visible
+	v8::HandleScope handleScope(isolate);
+	sandbox->modulesCache = modules.Open(v8::Local<v8::Context>::New(isolate, sandbox->context));
+
+	Metrics::Get().Add("sandbox.acquired");
+
+	return sandbox;
+}
+
+// Reset and return a sandbox to the pool
+void SandboxPool::Release(shared_ptr<Sandbox> sandbox) {
+
+	modules.Close(sandbox->modulesCache);
+	sandbox->modulesCache = 0;
+
+	// Discard worn out sandboxes (and any extra ones when the pool is full)
+	if ((maxUses > 0 && sandbox->uses >= maxUses) || (int)idle.size() >= size) {
+
+		Dispose(sandbox);
+		return;
+	}
+
+	v8::HandleScope handleScope(isolate);
+
+	Reset(v8::Local<v8::Context>::New(isolate, sandbox->context));
+
+	idle.push_back(sandbox);
+}
+
+// Dispose all idle sandboxes (new ones are created on demand)
+size_t SandboxPool::Shed() {
+
+	size_t count = idle.size();
+
+	for (auto it = idle.begin(); it != idle.end(); ++it) {
+		Dispose(*it);
+	}
+
+	idle.clear();
+
+	return count;
+}
+
+// Create a new sandbox
+shared_ptr<SandboxPool::Sandbox> SandboxPool::Create() {
+
+	double startTime = Metrics::Now();
+
+	v8::HandleScope handleScope(isolate);
+
+	shared_ptr<Sandbox> sandbox = make_shared<Sandbox>();
+	sandbox->uses = 0;
+	sandbox->modulesCache = 0;
+
+	v8::Handle<v8::Context> context = v8::Context::New(isolate, NULL, v8::Local<v8::ObjectTemplate>::New(isolate, global));
+	sandbox->context.Reset(isolate, context);
+
+	// Module cache ID slot exists from the start (embedder data reads are not bounds checked)
+	context->SetEmbedderData(MODULES_CACHE_DATA_INDEX, v8::Integer::NewFromUnsigned(0));
+
+	// Remember the initial global properties of a fresh context
+	if (builtInGlobals.empty()) {
+
+		v8::Handle<v8::Array> names = context->Global()->GetOwnPropertyNames();
+		uint_fast32 namesLength = names->Length();
+
+		for (uint_fast32 i = 0; i < namesLength; i++) {
+
+			v8::String::Utf8Value name(names->Get(i));
+
+			if (*name) {
+				builtInGlobals.insert(*name);
+			}
+		}
+	}
+
+	Metrics &metrics = Metrics::Get();
+	metrics.Add("sandbox.created");
+	metrics.Add("sandbox.createTime", Metrics::Now() - startTime);
+
+	return sandbox;
+}
+
+// Remove script defined globals from a sandbox context
+// NOTE: Changes to built-in objects (e.g. prototypes) are not reverted, use maxUses to limit their lifetime
+void SandboxPool::Reset(v8::Handle<v8::Context> context) {
+
+	v8::Context::Scope contextScope(context);
+
+	v8::Handle<v8::Object> globalObject = context->Global();
+	v8::Handle<v8::Array> names = globalObject->GetOwnPropertyNames();
+	uint_fast32 namesLength = names->Length();
+
+	for (uint_fast32 i = 0; i < namesLength; i++) {
+
+		v8::Handle<v8::Value> name = names->Get(i);
+		v8::String::Utf8Value nameString(name);
+
+		// Global variables (var) are not deletable, hence the ForceDelete()
+		if (*nameString && builtInGlobals.find(*nameString) == builtInGlobals.end()) {
+			globalObject->ForceDelete(name);
+		}
+	}
+}
+
+// Dispose sandbox context
+void SandboxPool::Dispose(shared_ptr<Sandbox> sandbox) {
+
+	sandbox->context.Dispose();
+	sandbox->context.Clear();
+
+	v8::V8::ContextDisposedNotification();
+
+	Metrics::Get().Add("sandbox.disposed");
+}
+
+// Destructor
+SandboxPool::~SandboxPool() {
+
+	for (auto it = idle.begin(); it != idle.end(); ++it) {
+		Dispose(*it);
+	}
+
+	global.Dispose();
+	global.Clear();
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+
+#include <unordered_set>
+#include <vector>
+
+class Modules;
+
+// Pool of pre-created sandbox execution contexts (with separate globals)
+// NOTE: Must only be used while holding the isolate lock
+class SandboxPool {
+
+public:
+
+	// Pooled sandbox context
+	struct Sandbox {
+
+		v8::Persistent<v8::Context> context;
+
+		// Number of times the sandbox was checked out
+		int uses;
+
+		// Module cache of the current checkout (require() never shares modules between checkouts)
+		uint32 modulesCache;
+	};
+
+	SandboxPool(v8::Isolate* isolate, v8::Handle<v8::ObjectTemplate> global, Modules &modules, int size, int maxUses);
+	~SandboxPool();
+
+	// Check out a sandbox from the pool (creates a new one if the pool is empty)
+	shared_ptr<Sandbox> Acquire();
+
+	// Reset and return a sandbox to the pool
+	void Release(shared_ptr<Sandbox> sandbox);
+
+	// Dispose all idle sandboxes (new ones are created on demand), returns the number of disposed sandboxes
+	size_t Shed();
+
+protected:
+
+	// Create a new sandbox
+	shared_ptr<Sandbox> Create();
+
+	// Remove script defined globals from a sandbox context
+	void Reset(v8::Handle<v8::Context> context);
+
+	// Dispose sandbox context
+	static void Dispose(shared_ptr<Sandbox> sandbox);
+
+private:
+
+	// V8 isolate and global object template shared by all sandboxes
+	v8::Isolate* isolate;
+	v8::Persistent<v8::ObjectTemplate> global;
+
+	// Module loader of the runtime
+	Modules &modules;
+
+	// Idle sandboxes
+	std::vector<shared_ptr<Sandbox>> idle;
+
+	// Built-in global property names of a fresh context
+	std::unordered_set<std::string> builtInGlobals;
+
+	// Maximum number of idle sandboxes kept in the pool
+	int size;
+
+	// Sandbox is discarded after this many uses (0 for no limit)
+	int maxUses;
+};
\ No newline at end of file
@@ -0,0 +1,156 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ScriptTable.h"
+#include "BackgroundScript.h"
+
+#include <cstdlib>
+
+// Maximum number of slots (script ID layout needs at least 16 generation bits)
+#define SCRIPT_TABLE_MAX_SIZE 0x10000U
+
+// Constructor
+ScriptTable::ScriptTable(uint32 size): slotBits(1) {
+
+	size = min(max(size, 1U), SCRIPT_TABLE_MAX_SIZE);
+
+	// Script ID layout (generation in high bits, slot index in low bits)
+	while ((1U << slotBits) < size) {
+		slotBits++;
+	}
+
+	slotMask = (1U << slotBits) - 1;
+	maxGeneration = 0xFFFFFFFFU >> slotBits;
+
+	slots.resize(size);
+
+	for (uint32 i = 0; i < size; i++) {
+
+		// Generation 0 is never used (script ID 0 is invalid)
+		slots[i].generation = 1;
+
+		// Lowest slots are used first
+		freeSlots.push_back(i);
+	}
+}
+
+// Add script to a free slot (returns script ID or 0 if the table is full)
+uint32 ScriptTable::Add(shared_ptr<BackgroundScript> script) {
+
+	if (freeSlots.empty()) {
+		return 0;
+	}
+
+	// Least recently freed slot (a stale ID only aliases after the whole generation range is used up)
+	uint32 index = freeSlots.front();
+	freeSlots.pop_front();
+
+	Slot &slot = slots[index];
+	slot.script = script;
+
+	return (slot.generation << slotBits) | index;
+}
+
+// Get script by ID (NULL for stale or invalid IDs)
+BackgroundScript* ScriptTable::Find(uint32 id) const {
+
+	uint32 index = id & slotMask;
+
+	if (index >= slots.size()) {
+		return NULL;
+	}
+
+	const Slot &slot = slots[index];
+
+	if (slot.generation != (id >> slotBits) || !slot.script) {
+		return NULL;
+	}
+
+	return slot.script.get();
+}
+
+// Get shared script state by ID (empty for stale or invalid IDs)
+shared_ptr<BackgroundScript> ScriptTable::Get(uint32 id) const {
+
+	if (Find(id) == NULL) {
+		return shared_ptr<BackgroundScript>();
+	}
+
+	return slots[id & slotMask].script;
+}
+
+// Remove script from its slot (bumps the slot generation)
+void ScriptTable::Remove(uint32 id) {
+
+	if (Find(id) == NULL) {
+		return;
+	}
+
+	uint32 index = id & slotMask;
+	Slot &slot = slots[index];
+
+	slot.script.reset();
+
+	// Skip generation 0 on wrap-around
+	if (++slot.generation > maxGeneration) {
+		slot.generation = 1;
+	}
+
+	freeSlots.push_back(index);
+}
+
+// Number of active scripts
+uint32 ScriptTable::Count() const {
+	return static_cast<uint32>(slots.size() - freeSlots.size());
+}
+
+// Number of free slots
+uint32 ScriptTable::Free() const {
+	return static_cast<uint32>(freeSlots.size());
+}
+
+// SQF script handle for a script ID (e.g. "#S1002a")
+std::string ScriptTable::ToHandle(uint32 id) {
+
+	char handle[16];
+
+	handle[0] = JS_PROTOCOL_COMMAND;
+	handle[1] = JS_PROTOCOL_TOKEN_SPAWN;
+
+	_ultoa(id, handle + JS_PROTOCOL_LENGTH, 16);
+
+	return handle;
+}
+
+// Parse SQF script handle (returns 0 for invalid handles)
+uint32 ScriptTable::FromHandle(const char* handle) {
+
+	if (handle[0] != JS_PROTOCOL_COMMAND || handle[1] != JS_PROTOCOL_TOKEN_SPAWN) {
+		return 0;
+	}
+
+	char* end = NULL;
+	unsigned long id = strtoul(handle + JS_PROTOCOL_LENGTH, &end, 16);
+
+	if (end == handle + JS_PROTOCOL_LENGTH || *end != '\0') {
+		return 0;
+	}
+
+	return static_cast<uint32>(id);
+}
\ No newline at end of file
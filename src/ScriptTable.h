@@ -0,0 +1,83 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+
+#include <deque>
+#include <vector>
+
+struct BackgroundScript;
+
+// Fixed size slot table of background scripts with generational integer handles
+// NOTE: Not thread safe (guarded by the background scripts mutex)
+class ScriptTable {
+
+public:
+
+	// NOTE: Table size is limited to 65536 slots (slot index is in the low bits of a script ID,
+	// the remaining high bits hold the slot generation)
+	ScriptTable(uint32 size);
+
+	// Add script to a free slot (returns script ID or 0 if the table is full)
+	uint32 Add(shared_ptr<BackgroundScript> script);
+
+	// Get script by ID (NULL for stale or invalid IDs)
+	BackgroundScript* Find(uint32 id) const;
+
+	// Get shared script state by ID (empty for stale or invalid IDs)
+	shared_ptr<BackgroundScript> Get(uint32 id) const;
+
+	// Remove script from its slot (bumps the slot generation)
+	void Remove(uint32 id);
+
+	// Number of active scripts
+	uint32 Count() const;
+
+	// Number of free slots
+	uint32 Free() const;
+
+	// SQF script handle for a script ID (e.g. "#S1002a")
+	static std::string ToHandle(uint32 id);
+
+	// Parse SQF script handle (returns 0 for invalid handles)
+	static uint32 FromHandle(const char* handle);
+
+private:
+
+	// Script slot
+	struct Slot {
+
+		shared_ptr<BackgroundScript> script;
+
+		// Incremented every time the slot is freed (stale IDs no longer match)
+		uint32 generation;
+	};
+
+	std::vector<Slot> slots;
+
+	// Free slot indexes (used as a FIFO queue, so reuse of a slot is spread across the whole table)
+	std::deque<uint32> freeSlots;
+
+	// Script ID layout: number of slot index bits (just enough for the table size) and the generation limit
+	uint32 slotBits;
+	uint32 slotMask;
+	uint32 maxGeneration;
+};
\ No newline at end of file
@@ -0,0 +1,93 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Settings.h"
+
+// Configuration file name (in the same directory as the extension DLL)
+#define SETTINGS_FILE "JavaScript.ini"
+
+// Isolate settings sections
+#define SETTINGS_SECTION_ISOLATE "Isolate"
+#define SETTINGS_SECTION_ISOLATE_SEPARATOR ":"
+
+// Maximum length of a string setting value
+#define SETTINGS_STRING_LENGTH 1024
+
+// Constructor
+Settings::Settings() {
+
+	HMODULE module = NULL;
+	char modulePath[MAX_PATH];
+
+	// Find extension DLL path (from the address of any function within it)
+	if (GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT, (LPCSTR)&Singleton<Settings>::Get, &module)) {
+
+		DWORD modulePathLength = GetModuleFileNameA(module, modulePath, MAX_PATH);
+
+		if (modulePathLength > 0 && modulePathLength < MAX_PATH) {
+			path.assign(modulePath, modulePathLength);
+		}
+	}
+
+	path = path.substr(0, path.find_last_of('\\') + 1);
+	path += SETTINGS_FILE;
+}
+
+// Get integer setting
+// NOTE: GetPrivateProfileIntA() can not be used, it returns 0 for negative values (e.g. ThreadPriority=-1)
+int Settings::GetInt(const char* section, const char* key, int defaultValue) const {
+
+	std::string value = GetString(section, key, "");
+
+	char* end = NULL;
+	long number = strtol(value.c_str(), &end, 10);
+
+	// Missing (or non-numeric) value
+	if (end == value.c_str()) {
+		return defaultValue;
+	}
+
+	return static_cast<int>(number);
+}
+
+// Get string setting
+std::string Settings::GetString(const char* section, const char* key, const char* defaultValue) const {
+
+	char value[SETTINGS_STRING_LENGTH];
+
+	DWORD valueLength = GetPrivateProfileStringA(section, key, defaultValue, value, SETTINGS_STRING_LENGTH, path.c_str());
+
+	return std::string(value, valueLength);
+}
+
+// Get isolate setting ([Isolate:<namespace>] section overrides the [Isolate] section)
+int Settings::GetIsolateInt(const std::string &name, const char* key, int defaultValue) const {
+
+	int value = GetInt(SETTINGS_SECTION_ISOLATE, key, defaultValue);
+
+	if (!name.empty()) {
+
+		std::string section(SETTINGS_SECTION_ISOLATE SETTINGS_SECTION_ISOLATE_SEPARATOR);
+		section += name;
+
+		value = GetInt(section.c_str(), key, value);
+	}
+
+	return value;
+}
\ No newline at end of file
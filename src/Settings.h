@@ -0,0 +1,45 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+#include "Singleton.h"
+
+// Runtime configuration (JavaScript.ini file next to the extension DLL)
+class Settings: public Singleton<Settings> {
+
+public:
+
+	Settings();
+
+	// Get integer setting
+	int GetInt(const char* section, const char* key, int defaultValue) const;
+
+	// Get string setting
+	std::string GetString(const char* section, const char* key, const char* defaultValue) const;
+
+	// Get isolate setting ([Isolate:<namespace>] section overrides the [Isolate] section)
+	int GetIsolateInt(const std::string &name, const char* key, int defaultValue) const;
+
+private:
+
+	// Full path to the configuration file
+	std::string path;
+};
\ No newline at end of file
@@ -0,0 +1,200 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ThreadPool.h"
+#include "Metrics.h"
+
+// Pool of the current worker thread
+__declspec(thread) static ThreadPool* currentPool = NULL;
+
+// Constructor
+ThreadPool::ThreadPool(size_t size, int agingTime, Job threadStart, size_t maxSize): threadStart(threadStart), size(size), maxSize(max(size, maxSize)), threads(0), blocked(0), idle(0), agingTime(agingTime * 1000.0), isStopping(false) {
+
+	std::lock_guard<std::mutex> lock(jobsMutex);
+
+	// NOTE: Threads are detached, the destructor waits until all of them are gone
+	for (size_t i = 0; i < size; i++) {
+
+		threads++;
+		std::thread(&ThreadPool::Worker, this).detach();
+	}
+}
+
+// Current worker thread starts (or stops) blocking in native code
+void ThreadPool::Blocking(bool isBlocking) {
+
+	ThreadPool* pool = currentPool;
+
+	if (pool == NULL) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(pool->jobsMutex);
+
+	if (isBlocking) {
+		pool->blocked++;
+		pool->Grow();
+	}
+	else {
+
+		pool->blocked--;
+
+		// Let an idle spare thread exit
+		if (pool->threads - pool->blocked > pool->size) {
+			pool->jobsCondition.notify_all();
+		}
+	}
+}
+
+// Start a spare thread if all threads are busy or blocked and there are fewer than size running ones
+void ThreadPool::Grow() {
+
+	if (isStopping || idle > 0 || threads >= maxSize || threads - blocked >= size) {
+		return;
+	}
+
+	threads++;
+	std::thread(&ThreadPool::Worker, this).detach();
+
+	Metrics::Get().Add("threads.spares");
+}
+
+// Queue a job for execution
+void ThreadPool::Post(Job job, int priority) {
+
+	Entry entry;
+	entry.job = job;
+	entry.queueTime = Metrics::Now();
+
+	priority = min(max(priority, 0), THREAD_POOL_PRIORITIES - 1);
+
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		jobs[priority].push_back(entry);
+
+		// Workers may all be blocked
+		Grow();
+	}
+
+	jobsCondition.notify_one();
+}
+
+// Number of queued (not yet started) jobs
+size_t ThreadPool::Pending() {
+
+	std::lock_guard<std::mutex> lock(jobsMutex);
+
+	size_t pending = 0;
+
+	for (int i = 0; i < THREAD_POOL_PRIORITIES; i++) {
+		pending += jobs[i].size();
+	}
+
+	return pending;
+}
+
+// Number of worker threads (not counting spare ones)
+size_t ThreadPool::Size() const {
+	return size;
+}
+
+// Worker thread loop
+void ThreadPool::Worker() {
+
+	currentPool = this;
+
+	if (threadStart) {
+		threadStart();
+	}
+
+	std::unique_lock<std::mutex> lock(jobsMutex);
+
+	while (true) {
+
+		int priority;
+
+		idle++;
+
+		// Spare threads exit once blocked workers are running again
+		while ((priority = Next()) < 0 && !isStopping && threads - blocked <= size) {
+			jobsCondition.wait(lock);
+		}
+
+		idle--;
+
+		if (isStopping || threads - blocked > size) {
+			break;
+		}
+
+		Job job = jobs[priority].front().job;
+		jobs[priority].pop_front();
+
+		lock.unlock();
+		job();
+		lock.lock();
+	}
+
+	threads--;
+	currentPool = NULL;
+
+	threadsCondition.notify_all();
+}
+
+// Get priority class of the next job to run (-1 if there are no jobs)
+int ThreadPool::Next() {
+
+	double now = Metrics::Now();
+
+	int next = -1;
+	double nextPriority = 0;
+
+	// Oldest job of every class competes with its aged priority
+	for (int i = 0; i < THREAD_POOL_PRIORITIES; i++) {
+
+		if (jobs[i].empty()) {
+			continue;
+		}
+
+		double priority = i;
+
+		if (agingTime > 0) {
+			priority -= floor((now - jobs[i].front().queueTime) / agingTime);
+		}
+
+		if (next < 0 || priority < nextPriority) {
+			next = i;
+			nextPriority = priority;
+		}
+	}
+
+	return next;
+}
+
+// Destructor
+ThreadPool::~ThreadPool() {
+
+	std::unique_lock<std::mutex> lock(jobsMutex);
+
+	isStopping = true;
+	jobsCondition.notify_all();
+
+	while (threads > 0) {
+		threadsCondition.wait(lock);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <vector>
+
+// Number of job priority classes
+#define THREAD_POOL_PRIORITIES JS_PRIORITY_CLASSES
+
+// Worker thread pool with a job queue
+// NOTE: Spare threads (up to the maximum size) run queued jobs while workers are blocked in native code
+class ThreadPool {
+
+public:
+
+	// Job executed by a worker thread
+	typedef std::function<void ()> Job;
+
+	// Queued jobs of a lower priority class are promoted by one class every aging time (in milliseconds, 0 for none)
+	// NOTE: Optional thread start job is run by each worker thread before any other job (e.g. to set its scheduling)
+	// NOTE: Maximum size limits worker and spare threads together (0 for a fixed size pool)
+	ThreadPool(size_t size, int agingTime = 0, Job threadStart = Job(), size_t maxSize = 0);
+	~ThreadPool();
+
+	// Current worker thread starts (or stops) blocking in native code (e.g. sleep, channel wait or HTTP transfer)
+	// NOTE: Does nothing outside of pool worker threads
+	static void Blocking(bool isBlocking);
+
+	// Queue a job for execution (lower priority class runs first)
+	void Post(Job job, int priority = 0);
+
+	// Number of queued (not yet started) jobs
+	size_t Pending();
+
+	// Number of worker threads (not counting spare ones)
+	size_t Size() const;
+
+protected:
+
+	// Worker thread loop
+	void Worker();
+
+	// Start a spare thread if all threads are busy or blocked and there are fewer than size running ones
+	// NOTE: Must be called while holding the jobs mutex
+	void Grow();
+
+	// Get priority class of the next job to run (-1 if there are no jobs)
+	// NOTE: Must be called while holding the jobs mutex
+	int Next();
+
+private:
+
+	// Worker thread start job
+	Job threadStart;
+
+	// Number of running (not blocked) threads the pool keeps and the thread limit
+	size_t size;
+	size_t maxSize;
+
+	// Number of live, blocked and idle (waiting for jobs) threads
+	// NOTE: Guarded by the jobs mutex
+	size_t threads;
+	size_t blocked;
+	size_t idle;
+
+	// Queued job
+	struct Entry {
+
+		Job job;
+
+		// Time when the job was queued (in microseconds)
+		double queueTime;
+	};
+
+	// Queued jobs (one queue per priority class)
+	std::deque<Entry> jobs[THREAD_POOL_PRIORITIES];
+	std::mutex jobsMutex;
+	std::condition_variable jobsCondition;
+
+	// Signaled when the last thread exits
+	std::condition_variable threadsCondition;
+
+	// Priority aging time (in microseconds)
+	double agingTime;
+
+	// Worker threads should exit
+	bool isStopping;
+};
\ No newline at end of file
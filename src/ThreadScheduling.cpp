@@ -0,0 +1,57 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ThreadScheduling.h"
+#include "Settings.h"
+#include "Metrics.h"
+
+// Apply scheduling settings to the current thread
+void ThreadScheduling::Apply(const char* section) {
+
+	Settings &settings = Settings::Get();
+	Metrics &metrics = Metrics::Get();
+
+	// Hexadecimal CPU affinity mask (0 for all cores)
+	std::string affinity = settings.GetString(section, "AffinityMask", settings.GetString("Threads", "AffinityMask", "0").c_str());
+	DWORD_PTR affinityMask = static_cast<DWORD_PTR>(_strtoui64(affinity.c_str(), NULL, 16));
+
+	if (affinityMask != 0) {
+
+		if (SetThreadAffinityMask(GetCurrentThread(), affinityMask) == 0) {
+			metrics.Add("threads.affinityFailed");
+		}
+		else {
+			metrics.Add("threads.pinned");
+		}
+	}
+
+	// Win32 thread priority (-2 lowest to 2 highest, 0 for normal, out of range values are clamped)
+	int priority = settings.GetInt(section, "ThreadPriority", settings.GetInt("Threads", "ThreadPriority", 0));
+	priority = min(max(priority, THREAD_PRIORITY_LOWEST), THREAD_PRIORITY_HIGHEST);
+
+	if (priority != THREAD_PRIORITY_NORMAL) {
+
+		if (!SetThreadPriority(GetCurrentThread(), priority)) {
+			metrics.Add("threads.priorityFailed");
+		}
+		else {
+			metrics.Add("threads.prioritized");
+		}
+	}
+}
\ No newline at end of file
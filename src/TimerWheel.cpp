@@ -0,0 +1,153 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TimerWheel.h"
+
+// Longest delay that fits into the wheel (longer timers are re-inserted on expiry)
+#define TIMER_WHEEL_MAX_TICKS ((uint64(1) << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)) - 1)
+
+// Constructor
+TimerWheel::TimerWheel(): currentTick(0) {
+}
+
+// Add timer expiring after a given number of ticks (at least one)
+void TimerWheel::Add(uint32 id, uint64 ticks) {
+
+	Remove(id);
+
+	Timer timer;
+	timer.id = id;
+	timer.expiry = currentTick + max(ticks, uint64(1));
+
+	Insert(timer);
+}
+
+// Remove timer
+void TimerWheel::Remove(uint32 id) {
+
+	auto it = timers.find(id);
+
+	if (it != timers.end()) {
+
+		it->second.slot->erase(it->second.position);
+		timers.erase(it);
+	}
+}
+
+// Advance the wheel by one tick and collect expired timer IDs
+void TimerWheel::Tick(std::vector<uint32> &expired) {
+
+	currentTick++;
+
+	// Cascade higher levels when lower level wraps around
+	for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+
+		if ((currentTick & ((uint64(1) << (level * TIMER_WHEEL_BITS)) - 1)) != 0) {
+			break;
+		}
+
+		Cascade(level);
+	}
+
+	Slot &slot = slots[0][currentTick & TIMER_WHEEL_MASK];
+
+	while (!slot.empty()) {
+
+		Timer timer = slot.front();
+
+		slot.pop_front();
+		timers.erase(timer.id);
+
+		// Timer delay was longer than the wheel span
+		if (timer.expiry > currentTick) {
+			Insert(timer);
+		}
+		else {
+			expired.push_back(timer.id);
+		}
+	}
+}
+
+// Check if there are no pending timers
+bool TimerWheel::IsEmpty() const {
+	return timers.empty();
+}
+
+// Move an empty wheel forward to a given tick
+void TimerWheel::Skip(uint64 tick) {
+
+	if (timers.empty() && tick > currentTick) {
+		currentTick = tick;
+	}
+}
+
+// Current tick
+uint64 TimerWheel::Now() const {
+	return currentTick;
+}
+
+// Insert timer into the slot matching its expiry
+void TimerWheel::Insert(const Timer &timer) {
+
+	uint64 delta = min(timer.expiry - currentTick, TIMER_WHEEL_MAX_TICKS);
+	uint64 expiry = currentTick + delta;
+
+	int level = 0;
+
+	while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (uint64(1) << ((level + 1) * TIMER_WHEEL_BITS))) {
+		level++;
+	}
+
+	Slot &slot = slots[level][(expiry >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK];
+
+	Location location;
+	location.slot = &slot;
+	location.position = slot.insert(slot.end(), timer);
+
+	timers[timer.id] = location;
+}
+
+// Move timers from a higher level slot to the lower levels
+void TimerWheel::Cascade(int level) {
+
+	Slot &slot = slots[level][(currentTick >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK];
+	Slot cascaded;
+
+	cascaded.swap(slot);
+
+	for (auto it = cascaded.begin(); it != cascaded.end(); ++it) {
+
+		timers.erase(it->id);
+
+		// Timer expiring right now must be picked up by the current tick
+		if (it->expiry <= currentTick) {
+
+			Slot &currentSlot = slots[0][currentTick & TIMER_WHEEL_MASK];
+
+			Location location;
+			location.slot = &currentSlot;
+			location.position = currentSlot.insert(currentSlot.end(), *it);
+
+			timers[it->id] = location;
+		}
+		else {
+			Insert(*it);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+
+#include <list>
+#include <vector>
+
+// Number of timer wheel levels and slots per level (2^6)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+// Hierarchical timer wheel (O(1) timer insert, remove and expire)
+class TimerWheel {
+
+public:
+
+	TimerWheel();
+
+	// Add timer expiring after a given number of ticks (at least one)
+	void Add(uint32 id, uint64 ticks);
+
+	// Remove timer
+	void Remove(uint32 id);
+
+	// Advance the wheel by one tick and collect expired timer IDs
+	void Tick(std::vector<uint32> &expired);
+
+	// Move an empty wheel forward to a given tick (nothing can expire)
+	void Skip(uint64 tick);
+
+	// Check if there are no pending timers
+	bool IsEmpty() const;
+
+	// Current tick
+	uint64 Now() const;
+
+protected:
+
+	// Pending timer
+	struct Timer {
+
+		uint32 id;
+
+		// Expiry tick
+		uint64 expiry;
+	};
+
+	typedef std::list<Timer> Slot;
+
+	// Insert timer into the slot matching its expiry
+	void Insert(const Timer &timer);
+
+	// Move timers from a higher level slot to the lower levels
+	void Cascade(int level);
+
+private:
+
+	// Timer location (for O(1) removal)
+	struct Location {
+
+		Slot* slot;
+		Slot::iterator position;
+	};
+
+	// Timer slots for each level
+	Slot slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+
+	// Pending timer locations (timer ID => location)
+	std::unordered_map<uint32, Location> timers;
+
+	// Current tick
+	uint64 currentTick;
+};
\ No newline at end of file
@@ -0,0 +1,176 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Watchdog.h"
+#include "Metrics.h"
+
+// Time budget armed on the current thread
+__declspec(thread) static uint64 currentDeadline = 0;
+__declspec(thread) static HANDLE currentEvent = NULL;
+
+// Constructor
+Watchdog::Watchdog(): lastID(0), isStopping(false) {
+}
+
+// Start a time budget for the script running on the current thread (returns deadline ID)
+uint64 Watchdog::Arm(v8::Isolate* isolate, int timeout) {
+
+	Deadline deadline;
+	deadline.isolate = isolate;
+	deadline.time = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+	deadline.threadID = v8::V8::GetCurrentThreadId();
+	deadline.isUnlocked = false;
+	deadline.isExpired = false;
+	deadline.event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	uint64 id;
+
+	{
+		std::lock_guard<std::mutex> lock(deadlinesMutex);
+
+		id = ++lastID;
+		deadlines[id] = deadline;
+
+		// Lazy start of the watchdog thread
+		if (!watchThread.joinable()) {
+			watchThread = std::thread(&Watchdog::Watch, this);
+		}
+	}
+
+	deadlinesCondition.notify_one();
+
+	currentDeadline = id;
+	currentEvent = deadline.event;
+
+	return id;
+}
+
+// Stop a time budget (returns true if it ran out and the script was terminated)
+bool Watchdog::Disarm(uint64 id) {
+
+	std::lock_guard<std::mutex> lock(deadlinesMutex);
+
+	auto it = deadlines.find(id);
+
+	if (it == deadlines.end()) {
+		return false;
+	}
+
+	bool isExpired = it->second.isExpired;
+
+	CloseHandle(it->second.event);
+	deadlines.erase(it);
+
+	if (currentDeadline == id) {
+		currentDeadline = 0;
+		currentEvent = NULL;
+	}
+
+	return isExpired;
+}
+
+// Current thread releases (or got back) the isolate lock during its time budget
+void Watchdog::SetUnlocked(bool isUnlocked) {
+
+	if (currentDeadline == 0) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(deadlinesMutex);
+
+	auto it = deadlines.find(currentDeadline);
+
+	if (it == deadlines.end()) {
+		return;
+	}
+
+	Deadline &deadline = it->second;
+	deadline.isUnlocked = isUnlocked;
+
+	// Budget ran out while the lock was released (current thread holds it again)
+	if (!isUnlocked && deadline.isExpired) {
+		v8::V8::TerminateExecution(deadline.threadID);
+	}
+}
+
+// Manual-reset event of the current thread budget
+HANDLE Watchdog::CurrentEvent() {
+	return currentEvent;
+}
+
+// Watchdog thread
+void Watchdog::Watch() {
+
+	std::unique_lock<std::mutex> lock(deadlinesMutex);
+
+	while (!isStopping) {
+
+		auto now = std::chrono::steady_clock::now();
+		auto next = std::chrono::steady_clock::time_point::max();
+
+		for (auto it = deadlines.begin(); it != deadlines.end(); ++it) {
+
+			Deadline &deadline = it->second;
+
+			if (deadline.isExpired) {
+				continue;
+			}
+
+			// NOTE: Termination is done while holding the deadlines lock, so
+			// a script that has already been disarmed (or released the lock) is never terminated
+			if (deadline.time <= now) {
+
+				// Script thread holds the isolate lock, otherwise another thread would be terminated
+				if (!deadline.isUnlocked) {
+					v8::V8::TerminateExecution(deadline.isolate);
+				}
+
+				SetEvent(deadline.event);
+				deadline.isExpired = true;
+
+				Metrics::Get().Add("exec.overruns");
+			}
+			else if (deadline.time < next) {
+				next = deadline.time;
+			}
+		}
+
+		if (next == std::chrono::steady_clock::time_point::max()) {
+			deadlinesCondition.wait(lock);
+		}
+		else {
+			deadlinesCondition.wait_until(lock, next);
+		}
+	}
+}
+
+// Destructor
+Watchdog::~Watchdog() {
+
+	{
+		std::lock_guard<std::mutex> lock(deadlinesMutex);
+		isStopping = true;
+	}
+
+	deadlinesCondition.notify_all();
+
+	if (watchThread.joinable()) {
+		watchThread.join();
+	}
+}
\ No newline at end of file
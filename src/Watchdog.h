@@ -0,0 +1,89 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+
+// Execution time budget watchdog (terminates scripts running past their deadline)
+// NOTE: Budget belongs to the thread that armed it, other threads holding the isolate lock are never terminated
+class Watchdog {
+
+public:
+
+	Watchdog();
+	~Watchdog();
+
+	// Start a time budget for the script running on the current thread in a given isolate (returns deadline ID)
+	// NOTE: Must be called while holding the isolate lock
+	uint64 Arm(v8::Isolate* isolate, int timeout);
+
+	// Stop a time budget (returns true if it ran out and the script was terminated)
+	// NOTE: Caller must cancel the isolate termination when true is returned
+	bool Disarm(uint64 id);
+
+	// Current thread releases (or got back) the isolate lock during its time budget
+	// NOTE: Budget that ran out while unlocked terminates the script once it gets the lock back
+	void SetUnlocked(bool isUnlocked);
+
+	// Manual-reset event of the current thread budget, signaled when it runs out (NULL if none)
+	static HANDLE CurrentEvent();
+
+protected:
+
+	// Watchdog thread
+	void Watch();
+
+private:
+
+	// Execution deadline
+	struct Deadline {
+
+		v8::Isolate* isolate;
+		std::chrono::steady_clock::time_point time;
+
+		// V8 thread ID of the script (termination target)
+		int threadID;
+
+		// Script thread does not hold the isolate lock (blocking native call)
+		bool isUnlocked;
+
+		// Budget ran out (TerminateExecution was called or is pending until the lock is taken)
+		bool isExpired;
+
+		// Signaled when the budget runs out (wakes up blocking native calls)
+		HANDLE event;
+	};
+
+	// Armed deadlines (deadline ID => deadline)
+	std::map<uint64, Deadline> deadlines;
+	std::mutex deadlinesMutex;
+	std::condition_variable deadlinesCondition;
+
+	// Last deadline ID
+	uint64 lastID;
+
+	// Watchdog thread (started on first armed deadline)
+	std::thread watchThread;
+	bool isStopping;
+};
\ No newline at end of file
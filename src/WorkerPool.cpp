@@ -0,0 +1,335 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "WorkerPool.h"
+#include "Extension.h"
+#include "Runtime.h"
+#include "JavaScript.h"
+#include "ThreadPool.h"
+#include "ThreadScheduling.h"
+#include "Natives.h"
+#include "Metrics.h"
+
+// Name of the worker isolate runtimes (for [Isolate:parallel] settings and GC metrics)
+#define WORKER_POOL_RUNTIME_NAME "parallel"
+
+// Worker isolate of the current worker thread
+__declspec(thread) static Runtime* currentRuntime = NULL;
+
+// Constructor
+WorkerPool::WorkerPool(size_t size): threads(new ThreadPool(size, 0, std::bind(ThreadScheduling::Apply, "Parallel"))) {
+}
+
+// Register parallel as a lazily installed native module
+void WorkerPool::Register() {
+	Natives::Get().Register("parallel", WorkerPool::Create);
+}
+
+// Create parallel module object (on first access)
+v8::Handle<v8::Value> WorkerPool::Create() {
+
+	v8::HandleScope handleScope(v8::Isolate::GetCurrent());
+	v8::PropertyAttribute attributes = static_cast<v8::PropertyAttribute>(v8::DontDelete | v8::ReadOnly);
+
+	v8::Handle<v8::ObjectTemplate> parallel = v8::ObjectTemplate::New();
+	parallel->Set(v8::String::NewSymbol("map"), v8::FunctionTemplate::New(WorkerPool::Map), attributes);
+	parallel->Set(v8::String::NewSymbol("threads"), v8::Integer::NewFromUnsigned(static_cast<uint32>(Extension::Get().workerPool->Size())), attributes);
+
+	return handleScope.Close(parallel->NewInstance());
+}
+
+// Number of worker threads (and isolates)
+size_t WorkerPool::Size() const {
+	return threads->Size();
+}
+
+// parallel.map(callback, array, chunk)
+void WorkerPool::Map(const v8::FunctionCallbackInfo<v8::Value>& args) {
+
+	v8::Isolate* isolate = args.GetIsolate();
+	v8::HandleScope handleScope(isolate);
+
+	// Worker would wait for jobs queued behind itself
+	if (currentRuntime != NULL) {
+		v8::ThrowException(v8::Exception::Error(v8::String::New("parallel.map() cannot be used inside a worker")));
+		return;
+	}
+
+	if (args.Length() < 2 || !(args[0]->IsFunction() || args[0]->IsString()) || !args[1]->IsArray()) {
+		v8::ThrowException(v8::Exception::TypeError(v8::String::New("Usage: parallel.map(callback, array, chunk)")));
+		return;
+	}
+
+	WorkerPool &pool = *Extension::Get().workerPool;
+	Metrics &metrics = Metrics::Get();
+
+	v8::Handle<v8::Array> array = v8::Handle<v8::Array>::Cast(args[1]);
+	uint32 length = array->Length();
+
+	// Split evenly between the workers by default
+	uint32 workers = static_cast<uint32>(pool.Size());
+	uint32 chunkSize = (length + workers - 1) / workers;
+
+	if (args.Length() > 2 && args[2]->IsNumber() && args[2]->Uint32Value() > 0) {
+		chunkSize = args[2]->Uint32Value();
+	}
+
+	chunkSize = max(chunkSize, 1U);
+
+	shared_ptr<Task> task = make_shared<Task>();
+	task->source = *v8::String::Utf8Value(args[0]->ToString());
+	task->token = CancellationToken::Current();
+
+	// Serialize input chunks
+	for (uint32 offset = 0; offset < length; offset += chunkSize) {
+
+		v8::HandleScope chunkScope(isolate);
+
+		uint32 size = min(chunkSize, length - offset);
+		v8::Handle<v8::Array> chunk = v8::Array::New(size);
+
+		for (uint32 i = 0; i < size; i++) {
+			chunk->Set(i, array->Get(offset + i));
+		}
+
+		v8::TryCatch tryCatch;
+		v8::Handle<v8::Value> json = JavaScript::CallJSON("stringify", chunk);
+
+		if (tryCatch.HasCaught()) {
+			tryCatch.ReThrow();
+			return;
+		}
+
+		task->input.push_back(*v8::String::Utf8Value(json));
+		task->offsets.push_back(offset);
+	}
+
+	size_t chunks = task->input.size();
+	task->output.resize(chunks);
+	task->pending = chunks;
+
+	for (size_t chunk = 0; chunk < chunks; chunk++) {
+		pool.threads->Post(std::bind(WorkerPool::Process, task, chunk));
+	}
+
+	double waitTime = Metrics::Now();
+
+	// Let other threads use this isolate while the workers are busy
+	JavaScript::Unlocked(isolate, [&]() {
+
+		std::unique_lock<std::mutex> lock(task->pendingMutex);
+
+		while (task->pending > 0) {
+			task->pendingCondition.wait(lock);
+		}
+	});
+
+	metrics.Add("parallel.maps");
+	metrics.Add("parallel.chunks", static_cast<double>(chunks));
+	metrics.Add("parallel.waitTime", Metrics::Now() - waitTime);
+
+	// Script is terminating (results are incomplete)
+	if (task->token.IsCancelled()) {
+		return;
+	}
+
+	if (!task->error.empty()) {
+		v8::ThrowException(v8::Exception::Error(v8::String::New(task->error.c_str())));
+		return;
+	}
+
+	// Gather results
+	v8::Handle<v8::Array> results = v8::Array::New(length);
+
+	for (size_t chunk = 0; chunk < chunks; chunk++) {
+
+		v8::HandleScope chunkScope(isolate);
+		v8::TryCatch tryCatch;
+
+		v8::Handle<v8::Value> output = JavaScript::CallJSON("parse", v8::String::New(task->output[chunk].c_str()));
+
+		if (tryCatch.HasCaught()) {
+			tryCatch.ReThrow();
+			return;
+		}
+
+		v8::Handle<v8::Array> outputArray = v8::Handle<v8::Array>::Cast(output);
+		uint32 offset = task->offsets[chunk];
+
+		for (uint32 i = 0; i < outputArray->Length(); i++) {
+			results->Set(offset + i, outputArray->Get(i));
+		}
+	}
+
+	args.GetReturnValue().Set(results);
+}
+
+// Process a single chunk on a worker thread
+void WorkerPool::Process(shared_ptr<Task> task, size_t chunk) {
+
+	double startTime = Metrics::Now();
+
+	Runtime* runtime = Extension::Get().workerPool->GetRuntime();
+	v8::Isolate* isolate = runtime->isolate;
+
+	std::string output;
+	std::string error;
+
+	// Chunks of a terminated script are skipped
+	if (task->token.IsCancelled()) {
+		Metrics::Get().Add("parallel.cancelledChunks");
+	}
+	else {
+		v8::Locker locker(isolate); // Critical section
+		v8::Isolate::Scope isolateScope(isolate);
+
+		runtime->SetStackLimit();
+
+		v8::HandleScope handleScope(isolate);
+		v8::Context::Scope contextScope(v8::Local<v8::Context>::New(isolate, runtime->context));
+
+		v8::TryCatch tryCatch;
+
+		// Mapping function (compiled as an expression)
+		v8::Handle<v8::Script> script = v8::Script::Compile(v8::String::New(("(" + task->source + ")").c_str()));
+		v8::Handle<v8::Value> function;
+
+		if (!script.IsEmpty()) {
+			function = script->Run();
+		}
+
+		if (!function.IsEmpty() && !function->IsFunction()) {
+			error = "parallel.map() callback is not a function";
+		}
+		else if (!function.IsEmpty()) {
+
+			v8::Handle<v8::Value> input = JavaScript::CallJSON("parse", v8::String::New(task->input[chunk].c_str()));
+
+			if (!input.IsEmpty()) {
+
+				v8::Handle<v8::Array> elements = v8::Handle<v8::Array>::Cast(input);
+				v8::Handle<v8::Array> results = v8::Array::New(elements->Length());
+
+				for (uint32 i = 0; i < elements->Length() && !tryCatch.HasCaught(); i++) {
+
+					v8::Handle<v8::Value> argv[] = { elements->Get(i), v8::Integer::NewFromUnsigned(task->offsets[chunk] + i) };
+					results->Set(i, v8::Handle<v8::Function>::Cast(function)->Call(v8::Context::GetCurrent()->Global(), 2, argv));
+				}
+
+				if (!tryCatch.HasCaught()) {
+
+					v8::Handle<v8::Value> json = JavaScript::CallJSON("stringify", results);
+
+					if (!json.IsEmpty()) {
+						output = *v8::String::Utf8Value(json);
+					}
+				}
+			}
+		}
+
+		if (tryCatch.HasCaught()) {
+			error = *v8::String::Utf8Value(tryCatch.Exception());
+		}
+	}
+
+	Metrics::Get().Add("parallel.chunkTime", Metrics::Now() - startTime);
+
+	{
+		std::lock_guard<std::mutex> lock(task->pendingMutex);
+
+		task->output[chunk] = output;
+
+		if (!error.empty() && task->error.empty()) {
+			task->error = error;
+		}
+
+		task->pending--;
+	}
+
+	task->pendingCondition.notify_one();
+}
+
+// Run body(0) to body(count - 1) on the worker threads (and the calling thread) and wait until all are done
+void WorkerPool::ParallelFor(size_t count, std::function<void (size_t)> body) {
+
+	if (count <= 1 || currentRuntime != NULL) {
+
+		for (size_t i = 0; i < count; i++) {
+			body(i);
+		}
+
+		return;
+	}
+
+	struct Pending {
+
+		size_t count;
+		std::mutex mutex;
+		std::condition_variable condition;
+	};
+
+	shared_ptr<Pending> pending = make_shared<Pending>();
+	pending->count = count - 1;
+
+	for (size_t i = 1; i < count; i++) {
+
+		threads->Post([pending, body, i]() {
+
+			body(i);
+
+			{
+				std::lock_guard<std::mutex> lock(pending->mutex);
+				pending->count--;
+			}
+
+			pending->condition.notify_one();
+		});
+	}
+
+	// Calling thread does its share too
+	body(0);
+
+	std::unique_lock<std::mutex> lock(pending->mutex);
+
+	while (pending->count > 0) {
+		pending->condition.wait(lock);
+	}
+}
+
+// Get (or create) the worker isolate of the current thread
+Runtime* WorkerPool::GetRuntime() {
+
+	if (currentRuntime == NULL) {
+
+		currentRuntime = new Runtime(WORKER_POOL_RUNTIME_NAME);
+
+		std::lock_guard<std::mutex> lock(runtimesMutex);
+		runtimes.push_back(unique_ptr<Runtime>(currentRuntime));
+	}
+
+	return currentRuntime;
+}
+
+// Destructor
+WorkerPool::~WorkerPool() {
+
+	// Stop worker threads before releasing their isolates
+	threads.reset();
+	runtimes.clear();
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+/*
+	Copyright (C) 2013 Simas Toleikis
+
+	This file is part of "JavaScript for ARMA" project.
+
+	JavaScript for ARMA is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Common.h"
+#include "CancellationToken.h"
+
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+class Runtime;
+class ThreadPool;
+
+// Pool of worker isolates (one per worker thread) for CPU-bound JavaScript (parallel.map)
+class WorkerPool {
+
+public:
+
+	WorkerPool(size_t size);
+	~WorkerPool();
+
+	// Register parallel as a lazily installed native module
+	static void Register();
+
+	// Create parallel module object (on first access)
+	static v8::Handle<v8::Value> Create();
+
+	// Number of worker threads (and isolates)
+	size_t Size() const;
+
+	// Run body(0) to body(count - 1) on the worker threads (and the calling thread) and wait until all are done
+	// NOTE: Runs serially when called from a worker thread (it would wait for jobs queued behind itself)
+	void ParallelFor(size_t count, std::function<void (size_t)> body);
+
+protected:
+
+	// Pending parallel.map() call shared with the worker threads
+	struct Task {
+
+		// Mapping function source code
+		std::string source;
+
+		// Serialized (JSON) input and output chunks
+		std::vector<std::string> input;
+		std::vector<std::string> output;
+
+		// Index of the first element of each chunk
+		std::vector<uint32> offsets;
+
+		// First exception message thrown by a worker
+		std::string error;
+
+		// Remaining chunks are skipped when the calling background script is terminated
+		CancellationToken token;
+
+		// Number of chunks still being processed
+		size_t pending;
+		std::mutex pendingMutex;
+		std::condition_variable pendingCondition;
+	};
+
+	// parallel.map(callback, array, chunk) maps array elements with callback(element, index) on worker isolates
+	// NOTE: Callback source is compiled in each worker (no closures), elements and results are copied as JSON
+	static void Map(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+	// Process a single chunk on a worker thread
+	static void Process(shared_ptr<Task> task, size_t chunk);
+
+	// Get (or create) the worker isolate of the current thread
+	Runtime* GetRuntime();
+
+private:
+
+	// Worker threads
+	unique_ptr<ThreadPool> threads;
+
+	// Worker isolates (created on the first job of each worker thread)
+	std::vector<unique_ptr<Runtime>> runtimes;
+	std::mutex runtimesMutex;
+};
\ No newline at end of file